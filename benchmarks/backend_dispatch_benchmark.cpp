@@ -0,0 +1,98 @@
+#include "mwl_impl.hpp"
+
+#include <chrono>
+#include <print>
+
+// Per-call overhead of the ways State::Impl can reach its backend: a direct call (single backend builds),
+// a call through a backend table (multiple backends) and the virtual call used before. The backend here
+// does next to nothing so the dispatch itself dominates.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t Iterations = 200'000'000;
+
+// Hides where a pointer came from so the compiler can't resolve calls through it at compile time
+template<typename T>
+static auto opaque(T* pointer) -> T*
+{
+    asm volatile("" : "+r"(pointer));
+    return pointer;
+}
+
+struct BenchStateImpl final : mwl::State::Impl
+{
+    uint64_t dispatch_count = 0;
+
+    auto dispatch_events(int32_t timeout_ms) -> bool
+    {
+        dispatch_count += static_cast<uint32_t>(timeout_ms) + 1;
+        return true;
+    }
+
+    auto connection_fd() const -> int32_t { return -1; }
+    auto internal_fds() const -> std::span<const int32_t> { return {}; }
+    auto prepare_read() -> bool { return true; }
+    auto read_events() -> bool { return true; }
+    void cancel_read() {}
+    auto flush() -> bool { return true; }
+    void roundtrip() {}
+    auto is_pixel_format_supported(mwl::PixelFormat) const -> bool { return true; }
+    auto get_outputs(std::span<mwl::Output>) -> size_t { return 0; }
+    auto get_underlying_resource(mwl::UnderlyingResourceID) const -> void* { return nullptr; }
+};
+
+struct VirtualState
+{
+    virtual ~VirtualState() = default;
+    virtual auto dispatch_events(int32_t timeout_ms) -> bool = 0;
+};
+
+struct VirtualBenchState final : VirtualState
+{
+    uint64_t dispatch_count = 0;
+
+    auto dispatch_events(int32_t timeout_ms) -> bool override
+    {
+        dispatch_count += static_cast<uint32_t>(timeout_ms) + 1;
+        return true;
+    }
+};
+
+template<typename Func>
+static auto measure_ns_per_call(Func&& call) -> double
+{
+    const auto start = Clock::now();
+
+    for (size_t i = 0; i < Iterations; ++i)
+    {
+        call(static_cast<int32_t>(i & 1));
+    }
+
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Iterations;
+}
+
+int main()
+{
+    static constexpr auto table = mwl::make_state_backend_table<BenchStateImpl>();
+
+    auto state = BenchStateImpl{};
+    auto virtual_state = VirtualBenchState{};
+
+    auto* direct_impl = opaque(&state);
+    auto* table_impl = opaque(static_cast<mwl::State::Impl*>(&state));
+    const auto* backend = opaque(&table);
+    auto* virtual_impl = opaque(static_cast<VirtualState*>(&virtual_state));
+
+    const auto direct_ns = measure_ns_per_call([&](int32_t timeout) { direct_impl->dispatch_events(timeout); });
+    const auto table_ns = measure_ns_per_call([&](int32_t timeout) { backend->dispatch_events(table_impl, timeout); });
+    const auto virtual_ns = measure_ns_per_call([&](int32_t timeout) { virtual_impl->dispatch_events(timeout); });
+
+    std::println("{:>8}: {:6.3f} ns/call", "direct", direct_ns);
+    std::println("{:>8}: {:6.3f} ns/call", "table", table_ns);
+    std::println("{:>8}: {:6.3f} ns/call", "virtual", virtual_ns);
+
+    // Keeps the calls from being optimized away
+    std::println("({} dispatches)", state.dispatch_count + virtual_state.dispatch_count);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "mwl_impl.hpp"
+
+#include <chrono>
+#include <print>
+
+// Dispatches a million synthetic key events through the std::function callbacks and through an InputListener,
+// both on their own and through the full emit path of a window (input state, event queue check, handler).
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t EventCount = 1'000'000;
+
+struct CountingListener
+{
+    uint64_t sum = 0;
+
+    void on_key(mwl::KeyEvent event)
+    {
+        sum += event.key;
+    }
+};
+
+template<typename Func>
+static auto measure_ns_per_event(Func&& dispatch) -> double
+{
+    const auto start = Clock::now();
+
+    for (uint32_t i = 0; i < EventCount; ++i)
+    {
+        const auto state = i & 1 ? mwl::ButtonState::Released : mwl::ButtonState::Pressed;
+        dispatch(mwl::KeyEvent(MWL_KEY_A + (i >> 1) % 26, state, false, {}));
+    }
+
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / EventCount;
+}
+
+int main()
+{
+    auto listener = CountingListener{};
+    auto callback_sum = uint64_t{};
+
+    // Stored the same way Window::Impl stores them, so the compiler can't see through either
+    auto callback = mwl::Window::KeyCallback([&](mwl::KeyEvent event) { callback_sum += event.key; });
+    auto input_listener = mwl::InputListener::bind(listener);
+    asm volatile("" : : "r"(&callback), "r"(&input_listener) : "memory");
+
+    const auto direct_ns = measure_ns_per_event([&](mwl::KeyEvent event) { listener.on_key(event); });
+    const auto function_ns = measure_ns_per_event([&](mwl::KeyEvent event) { callback(event); });
+    const auto listener_ns = measure_ns_per_event([&](mwl::KeyEvent event) { input_listener.on_key(input_listener.object, event); });
+
+    auto state_impl = mwl::State::Impl{};
+    auto window = mwl::Window::Impl{};
+    window.state = mwl::State{ &state_impl };
+
+    window.key_callback = callback;
+    const auto emit_function_ns = measure_ns_per_event([&](mwl::KeyEvent event) { window.emit_key_event(event); });
+
+    window.key_callback = nullptr;
+    window.input_listener = input_listener;
+    const auto emit_listener_ns = measure_ns_per_event([&](mwl::KeyEvent event) { window.emit_key_event(event); });
+
+    std::println("{:>24}: {:6.2f} ns/event", "direct call", direct_ns);
+    std::println("{:>24}: {:6.2f} ns/event", "std::function", function_ns);
+    std::println("{:>24}: {:6.2f} ns/event", "InputListener", listener_ns);
+    std::println("{:>24}: {:6.2f} ns/event", "emit + std::function", emit_function_ns);
+    std::println("{:>24}: {:6.2f} ns/event", "emit + InputListener", emit_listener_ns);
+
+    // Keeps the handlers from being optimized away
+    std::println("({} / {})", listener.sum, callback_sum);
+
+    return 0;
+}
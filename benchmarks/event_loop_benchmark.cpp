@@ -0,0 +1,173 @@
+#include "mwl_io_uring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <print>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Emulates the fds dispatch_events waits on: a socket standing in for the Wayland connection,
+// with a second thread playing the compositor, plus an idle fd standing in for the key repeat timer.
+// Run under `strace -c -f` or `perf trace -s` to see the full syscall breakdown, the counts printed
+// here only cover the waiting itself.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t Iterations = 100'000;
+
+struct Result
+{
+    double average_us;
+    double p99_us;
+    double syscalls_per_wait;
+};
+
+template<typename WaitFn>
+static auto measure_round_trips(int compositor_fd, int client_fd, int idle_fd, WaitFn&& wait) -> Result
+{
+    auto latencies = std::vector<double>(Iterations);
+
+    auto compositor = std::jthread([&]
+    {
+        auto byte = char{};
+
+        for (size_t i = 0; i < Iterations; ++i)
+        {
+            // Wait for the client to ask for the next event, like a frame callback after a commit
+            if (read(compositor_fd, &byte, 1) != 1 || write(compositor_fd, &byte, 1) != 1)
+            {
+                return;
+            }
+        }
+    });
+
+    auto fds = std::array {
+        pollfd { .fd = client_fd, .events = POLLIN, .revents = 0 },
+        pollfd { .fd = idle_fd, .events = POLLIN, .revents = 0 },
+    };
+
+    auto byte = char{};
+    auto syscalls = uint64_t{};
+
+    for (size_t i = 0; i < Iterations; ++i)
+    {
+        const auto start = Clock::now();
+
+        if (write(client_fd, &byte, 1) != 1)
+        {
+            break;
+        }
+
+        while (!(fds[0].revents & POLLIN))
+        {
+            syscalls += wait(fds);
+        }
+
+        if (read(client_fd, &byte, 1) != 1)
+        {
+            break;
+        }
+
+        fds[0].revents = 0;
+        latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    std::ranges::sort(latencies);
+
+    auto total = 0.0;
+
+    for (auto latency : latencies)
+    {
+        total += latency;
+    }
+
+    return {
+        .average_us = total / Iterations,
+        .p99_us = latencies[Iterations * 99 / 100],
+        .syscalls_per_wait = static_cast<double>(syscalls) / Iterations,
+    };
+}
+
+// Non-blocking dispatch with nothing to read, which is what dispatch_pending does every frame
+template<typename WaitFn>
+static auto measure_idle_dispatch(int client_fd, int idle_fd, WaitFn&& wait) -> Result
+{
+    auto fds = std::array {
+        pollfd { .fd = client_fd, .events = POLLIN, .revents = 0 },
+        pollfd { .fd = idle_fd, .events = POLLIN, .revents = 0 },
+    };
+
+    auto syscalls = uint64_t{};
+    const auto start = Clock::now();
+
+    for (size_t i = 0; i < Iterations; ++i)
+    {
+        syscalls += wait(fds);
+    }
+
+    const auto total = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    return {
+        .average_us = total / Iterations,
+        .p99_us = 0.0,
+        .syscalls_per_wait = static_cast<double>(syscalls) / Iterations,
+    };
+}
+
+static void print_result(std::string_view name, const Result& result)
+{
+    std::println("{:>10}: {:8.2f} us avg, {:8.2f} us p99, {:5.2f} syscalls per wait", name, result.average_us, result.p99_us, result.syscalls_per_wait);
+}
+
+int main()
+{
+    int sockets[2];
+    int idle[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0 || pipe(idle) != 0)
+    {
+        std::println("Unable to create sockets");
+        return 1;
+    }
+
+    auto poller = mwl::IoUringPoller{};
+
+    if (!poller.init(8))
+    {
+        std::println("Unable to create an io_uring");
+        return 1;
+    }
+
+    auto poll_wait = [](std::span<pollfd> fds, int32_t timeout_ms) -> uint64_t
+    {
+        poll(fds.data(), fds.size(), timeout_ms);
+        return 1;
+    };
+
+    auto io_uring_wait = [&](std::span<pollfd> fds, int32_t timeout_ms) -> uint64_t
+    {
+        const auto before = poller.syscall_count();
+        poller.wait(fds, timeout_ms);
+        return poller.syscall_count() - before;
+    };
+
+    std::println("----- Round trip ({} iterations) -----", Iterations);
+    print_result("poll", measure_round_trips(sockets[1], sockets[0], idle[0], [&](auto& fds) { return poll_wait(fds, -1); }));
+    print_result("io_uring", measure_round_trips(sockets[1], sockets[0], idle[0], [&](auto& fds) { return io_uring_wait(fds, -1); }));
+
+    std::println("----- Idle dispatch ({} iterations) -----", Iterations);
+    print_result("poll", measure_idle_dispatch(sockets[0], idle[0], [&](auto& fds) { return poll_wait(fds, 0); }));
+    print_result("io_uring", measure_idle_dispatch(sockets[0], idle[0], [&](auto& fds) { return io_uring_wait(fds, 0); }));
+
+    close(sockets[0]);
+    close(sockets[1]);
+    close(idle[0]);
+    close(idle[1]);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "mwl_fill.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <print>
+#include <string_view>
+
+using Clock = std::chrono::steady_clock;
+
+struct FillCase
+{
+    std::string_view name;
+    size_t width;
+    size_t height;
+    size_t stride;
+};
+
+template<typename Func>
+static auto measure_gbps(const FillCase& fill_case, size_t iterations, Func&& func) -> double
+{
+    // Warm up so page faults from the first touch don't end up in the measurement
+    func();
+
+    const auto start = Clock::now();
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto bytes = static_cast<double>(fill_case.width * fill_case.height * sizeof(uint32_t)) * iterations;
+    return bytes / seconds / 1e9;
+}
+
+static auto kernel_name(mwl::FillKernel kernel) -> std::string_view
+{
+    switch (kernel)
+    {
+        case mwl::FillKernel::Scalar: return "Scalar";
+        case mwl::FillKernel::SSE2: return "SSE2";
+        case mwl::FillKernel::AVX2: return "AVX2";
+        case mwl::FillKernel::AVX512: return "AVX512";
+    }
+
+    return "Unknown";
+}
+
+int main()
+{
+    static constexpr auto cases = std::array {
+        FillCase { "4K clear", 3840, 2160, 3840 },
+        FillCase { "1080p clear", 1920, 1080, 1920 },
+        FillCase { "256x256 rect", 256, 256, 3840 },
+        FillCase { "64x64 rect", 64, 64, 3840 },
+    };
+
+    static constexpr size_t max_pixels = 3840 * 2160;
+    auto* pixels = static_cast<uint32_t*>(std::aligned_alloc(64, max_pixels * sizeof(uint32_t)));
+
+    std::println("Best kernel: {}", kernel_name(mwl::best_fill_kernel()));
+
+    for (const auto& fill_case : cases)
+    {
+        // Aim for roughly 4 GB worth of writes per measurement
+        const auto iterations = std::max<size_t>(1, 4'000'000'000 / (fill_case.width * fill_case.height * sizeof(uint32_t)));
+
+        std::println("----- {} ({}x{}) -----", fill_case.name, fill_case.width, fill_case.height);
+
+        const auto baseline = measure_gbps(fill_case, iterations, [&]
+        {
+            for (size_t y = 0; y < fill_case.height; ++y)
+            {
+                std::fill_n(pixels + y * fill_case.stride, fill_case.width, 0xFF222222);
+            }
+        });
+
+        std::println("{:>16}: {:8.2f} GB/s", "std::fill_n", baseline);
+
+        for (auto kernel : { mwl::FillKernel::Scalar, mwl::FillKernel::SSE2, mwl::FillKernel::AVX2, mwl::FillKernel::AVX512 })
+        {
+            if (!mwl::is_fill_kernel_supported(kernel))
+            {
+                continue;
+            }
+
+            for (auto streaming : { false, true })
+            {
+                const auto gbps = measure_gbps(fill_case, iterations, [&]
+                {
+                    mwl::fill_pixels(kernel, pixels, fill_case.stride, fill_case.width, fill_case.height, 0xFF222222, streaming);
+                });
+
+                std::println("{:>9}{:>7}: {:8.2f} GB/s ({:.2f}x)", kernel_name(kernel), streaming ? " (NT)" : "", gbps, gbps / baseline);
+            }
+        }
+
+        const auto dispatched = measure_gbps(fill_case, iterations, [&]
+        {
+            mwl::fill_pixels(pixels, fill_case.stride, fill_case.width, fill_case.height, 0xFF222222);
+        });
+
+        std::println("{:>16}: {:8.2f} GB/s ({:.2f}x)", "dispatched", dispatched, dispatched / baseline);
+    }
+
+    std::free(pixels);
+
+    return 0;
+}
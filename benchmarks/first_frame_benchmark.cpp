@@ -0,0 +1,153 @@
+#include <mwl/mwl.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <print>
+#include <string_view>
+#include <vector>
+
+// Time from startup until every window has its first frame on screen, the way examples/simple_window.cpp
+// starts up, with one and with twenty windows. Also prints where State::create spends its time.
+// Needs a running compositor.
+
+using Clock = std::chrono::steady_clock;
+
+enum class CreationMode
+{
+    Blocking,
+    Batch,
+    Async,
+};
+
+static auto mode_name(CreationMode mode) -> std::string_view
+{
+    switch (mode)
+    {
+        case CreationMode::Blocking: return "create";
+        case CreationMode::Batch: return "create_batch";
+        case CreationMode::Async: return "create_async";
+    }
+
+    return "Unknown";
+}
+
+struct Result
+{
+    double state_ms;
+    double first_frame_ms;
+};
+
+static auto to_ms(std::chrono::nanoseconds duration) -> double
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static auto measure_first_frame(CreationMode mode, size_t window_count) -> Result
+{
+    const auto start = Clock::now();
+
+    auto state = mwl::State::create({
+        .client_api = mwl::ClientAPI::Auto
+    });
+
+    const auto state_created = Clock::now();
+
+    auto windows = std::vector<mwl::Window>(window_count);
+    auto frames_done = size_t{};
+
+    switch (mode)
+    {
+        case CreationMode::Blocking:
+        {
+            for (auto& window : windows)
+            {
+                window = mwl::Window::create(state, "First Frame", 640, 480);
+            }
+
+            break;
+        }
+        case CreationMode::Batch:
+        {
+            auto descs = std::vector<mwl::Window::Desc>(window_count, { "First Frame", 640, 480 });
+            mwl::Window::create_batch(state, descs, windows);
+            break;
+        }
+        case CreationMode::Async:
+        {
+            for (auto& window : windows)
+            {
+                window = mwl::Window::create_async(state, "First Frame", 640, 480);
+                window.set_configured_callback([window] { window.show(); });
+            }
+
+            break;
+        }
+    }
+
+    for (auto& window : windows)
+    {
+        window.set_frame_callback([&] { ++frames_done; });
+
+        if (window.is_configured())
+        {
+            window.show();
+        }
+    }
+
+    while (frames_done < window_count)
+    {
+        state.dispatch_events();
+    }
+
+    const auto end = Clock::now();
+
+    for (auto& window : windows)
+    {
+        window.destroy();
+    }
+
+    state.destroy();
+
+    return {
+        .state_ms = to_ms(state_created - start),
+        .first_frame_ms = to_ms(end - state_created),
+    };
+}
+
+int main()
+{
+    static constexpr size_t Runs = 5;
+
+    {
+        auto state = mwl::State::create({
+            .client_api = mwl::ClientAPI::Auto
+        });
+
+        const auto profile = state.startup_profile();
+        std::println("startup: connect {:.2f} ms, globals {:.2f} ms, setup {:.2f} ms, total {:.2f} ms",
+            to_ms(profile.connect), to_ms(profile.globals), to_ms(profile.setup), to_ms(profile.total));
+
+        state.destroy();
+    }
+
+    for (size_t window_count : { 1, 20 })
+    {
+        std::println("----- {} window(s) -----", window_count);
+
+        for (auto mode : { CreationMode::Blocking, CreationMode::Batch, CreationMode::Async })
+        {
+            auto best = Result { 1e9, 1e9 };
+
+            for (size_t run = 0; run < Runs; ++run)
+            {
+                const auto result = measure_first_frame(mode, window_count);
+                best.state_ms = std::min(best.state_ms, result.state_ms);
+                best.first_frame_ms = std::min(best.first_frame_ms, result.first_frame_ms);
+            }
+
+            std::println("{:>14}: state {:7.2f} ms, first frame {:7.2f} ms", mode_name(mode), best.state_ms, best.first_frame_ms);
+        }
+    }
+
+    return 0;
+}
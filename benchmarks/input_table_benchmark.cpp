@@ -0,0 +1,97 @@
+#include "mwl_linux_input_tables.hpp"
+
+#include <chrono>
+#include <map>
+#include <print>
+#include <random>
+#include <vector>
+
+// Compares the dense translation tables against the std::map lookups they replaced.
+// Codes are shuffled so the branch predictor can't learn the access pattern, which
+// is closer to real typing than iterating the table in order.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t Iterations = 20'000'000;
+
+template<typename Func>
+static auto measure_ns_per_lookup(const std::vector<uint32_t>& codes, Func&& translate) -> double
+{
+    auto checksum = uint32_t{};
+    const auto start = Clock::now();
+
+    for (size_t i = 0; i < Iterations; ++i)
+    {
+        checksum += translate(codes[i % codes.size()]);
+    }
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the loop from being optimized away
+    if (checksum == 0x12345678)
+    {
+        std::println("");
+    }
+
+    return elapsed / Iterations;
+}
+
+template<size_t Count>
+static auto make_map(const std::array<mwl::InputCodeMapping, Count>& mappings) -> std::map<uint32_t, uint32_t>
+{
+    auto map = std::map<uint32_t, uint32_t>{};
+
+    for (const auto& mapping : mappings)
+    {
+        map.emplace(mapping.from, mapping.to);
+    }
+
+    return map;
+}
+
+template<size_t Count>
+static auto make_codes(const std::array<mwl::InputCodeMapping, Count>& mappings) -> std::vector<uint32_t>
+{
+    auto codes = std::vector<uint32_t>{};
+    auto rng = std::mt19937(1234);
+
+    // 4096 entries so the codes fit in L1 and only the lookup itself is measured
+    for (size_t i = 0; i < 4096; ++i)
+    {
+        codes.push_back(mappings[rng() % mappings.size()].from);
+    }
+
+    return codes;
+}
+
+int main()
+{
+    const auto key_map = make_map(mwl::key_mappings);
+    const auto button_map = make_map(mwl::button_mappings);
+    const auto key_codes = make_codes(mwl::key_mappings);
+    const auto button_codes = make_codes(mwl::button_mappings);
+
+    std::println("Key table: {} entries ({} bytes), reverse: {} entries", mwl::key_table.size(), sizeof(mwl::key_table), mwl::reverse_key_table.size());
+
+    const auto key_map_ns = measure_ns_per_lookup(key_codes, [&](uint32_t code)
+    {
+        // Mirrors the contains() + at() pair the Wayland backend used to do
+        return key_map.contains(code) ? key_map.at(code) : mwl::InvalidInputCode;
+    });
+
+    const auto key_table_ns = measure_ns_per_lookup(key_codes, mwl::translate_key);
+
+    const auto button_map_ns = measure_ns_per_lookup(button_codes, [&](uint32_t code)
+    {
+        return button_map.contains(code) ? button_map.at(code) : mwl::InvalidInputCode;
+    });
+
+    const auto button_table_ns = measure_ns_per_lookup(button_codes, mwl::translate_button);
+
+    std::println("{:>16}: {:6.2f} ns/lookup", "key std::map", key_map_ns);
+    std::println("{:>16}: {:6.2f} ns/lookup ({:.1f}x)", "key table", key_table_ns, key_map_ns / key_table_ns);
+    std::println("{:>16}: {:6.2f} ns/lookup", "button std::map", button_map_ns);
+    std::println("{:>16}: {:6.2f} ns/lookup ({:.1f}x)", "button table", button_table_ns, button_map_ns / button_table_ns);
+
+    return 0;
+}
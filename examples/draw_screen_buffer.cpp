@@ -13,9 +13,10 @@ int main()
     auto win = mwl::Window::create(mwl_state, "Hello", 1920, 1080);
     win.set_close_callback([&] { is_running = false; });
 
-    win.set_size_callback([&](int32_t width, int32_t height)
+    win.set_native_scaling(true);
+    win.set_size_callback([&](mwl::SizeEvent event)
     {
-        std::println("Window Size = {}, {}", width, height);
+        std::println("Window Size = {}, {} ({}, {} at {}x)", event.width, event.height, event.physical_width, event.physical_height, event.scale);
     });
 
     win.show();
@@ -24,21 +25,32 @@ int main()
     {
         mwl_state.dispatch_events();
 
+        // Don't bother drawing a new frame until the compositor is ready to show it. Gives up
+        // once the window is closed, hidden windows may never get another frame.
+        if (!win.wait_for_frame())
+        {
+            continue;
+        }
+
         auto buffer = win.fetch_screen_buffer();
 
         if (buffer)
         {
-            for (int32_t x = 0; x < win.width(); x++)
+            auto pixels = buffer.view();
+
+            for (int32_t y = 0; y < pixels.height; y++)
             {
-                for (int32_t y = 0; y < win.height(); y++)
+                auto row = pixels.row(y);
+
+                for (int32_t x = 0; x < pixels.width; x++)
                 {
                     if ((x + y / 32 * 32) % 64 < 32)
                     {
-                        buffer[y * win.width() + x] = 0xFF666666;
+                        row[x] = 0xFF666666;
                     }
                     else
                     {
-                        buffer[y * win.width() + x] = 0xFFEEEEEE;
+                        row[x] = 0xFFEEEEEE;
                     }
                 }
             }
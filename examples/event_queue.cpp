@@ -0,0 +1,75 @@
+#include "example_helper.hpp"
+
+#include <array>
+#include <print>
+
+int main()
+{
+    auto is_running = true;
+
+    auto mwl_state = mwl::State::create({
+        .client_api = mwl::ClientAPI::Auto,
+        .event_queue_capacity = 256,
+    });
+
+    auto win = mwl::Window::create(mwl_state, "Hello", 1920, 1080);
+    win.show();
+
+    auto events = std::array<mwl::Event, 64>{};
+
+    while (is_running)
+    {
+        mwl_state.dispatch_events();
+
+        while (auto count = mwl_state.poll_events(events))
+        {
+            for (const auto& event : std::span(events).first(count))
+            {
+                switch (event.type)
+                {
+                    case mwl::EventType::Close:
+                    {
+                        is_running = false;
+                        break;
+                    }
+                    case mwl::EventType::Size:
+                    {
+                        std::println("SizeEvent(Width: {}, Height: {})", event.size.width, event.size.height);
+                        break;
+                    }
+                    case mwl::EventType::Key:
+                    {
+                        std::println("KeyEvent(Key: {}, State: {})", event.key.key, event.key.state == mwl::ButtonState::Pressed ? "Pressed" : "Released");
+                        break;
+                    }
+                    case mwl::EventType::MouseMotion:
+                    {
+                        std::println("MouseMotionEvent(X: {}, Y: {})", event.mouse_motion.x, event.mouse_motion.y);
+                        break;
+                    }
+                    case mwl::EventType::MouseButton:
+                    {
+                        std::println("ButtonEvent(Button: {}, State: {})", event.mouse_button.button(), event.mouse_button.state() == mwl::ButtonState::Pressed ? "Pressed" : "Released");
+                        break;
+                    }
+                    case mwl::EventType::MouseScroll:
+                    {
+                        std::println("ScrollEvent(Value: {})", event.mouse_scroll.value());
+                        break;
+                    }
+                    default:
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        draw_checkerboard(win);
+    }
+
+    win.destroy();
+    mwl_state.destroy();
+
+    return 0;
+}
@@ -11,17 +11,21 @@ inline void draw_checkerboard(mwl::Window win)
         return;
     }
     
-    for (int32_t x = 0; x < win.width(); x++)
+    auto pixels = buffer.view();
+
+    for (int32_t y = 0; y < pixels.height; y++)
     {
-        for (int32_t y = 0; y < win.height(); y++)
+        auto row = pixels.row(y);
+
+        for (int32_t x = 0; x < pixels.width; x++)
         {
             if ((x + y / 32 * 32) % 64 < 32)
             {
-                buffer[y * win.width() + x] = 0xFF666666;
+                row[x] = 0xFF666666;
             }
             else
             {
-                buffer[y * win.width() + x] = 0xFFEEEEEE;
+                row[x] = 0xFFEEEEEE;
             }
         }
     }
@@ -1,6 +1,8 @@
 #include "example_helper.hpp"
 
+#include <array>
 #include <print>
+#include <span>
 
 int main()
 {
@@ -10,6 +12,14 @@ int main()
         .client_api = mwl::ClientAPI::Auto
     });
 
+    auto outputs = std::array<mwl::Output, 8>{};
+    const auto output_count = mwl_state.get_outputs(outputs);
+
+    for (const auto& output : std::span(outputs).first(output_count))
+    {
+        std::println("Output {}: {} ({} {})", output.name, output.description, output.make, output.model);
+    }
+
     auto win = mwl::Window::create(mwl_state, "Hello", 1920, 1080);
     win.set_close_callback([&] { is_running = false; });
     win.show();
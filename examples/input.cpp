@@ -15,12 +15,14 @@ int main()
 
     win.set_key_callback([](mwl::KeyEvent event)
     {
-        std::println("Key {} is {}", event.key, event.state == mwl::ButtonState::Pressed ? "Pressed" : "Released");
+        const auto latency = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(event.timestamp);
+        std::println("Key {} is {} ({} since input)", event.key, event.state == mwl::ButtonState::Pressed ? "Pressed" : "Released", std::chrono::duration_cast<std::chrono::microseconds>(latency));
     });
 
-    win.set_mouse_motion_callback([](mwl::MouseMotionEvent event)
+    win.set_motion_coalescing(mwl::MotionCoalescing::Accumulate);
+    win.set_mouse_motion_callback([&](mwl::MouseMotionEvent event)
     {
-        std::println("MouseMotionEvent(X: {}, Y: {})", event.x, event.y);
+        std::println("MouseMotionEvent(X: {}, Y: {}, DeltaX: {}, DeltaY: {}, Samples: {})", event.x, event.y, event.delta_x, event.delta_y, win.motion_samples().size());
     });
 
     win.set_mouse_button_callback([](mwl::MouseButtonEvent event)
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <span>
 #include <string_view>
+#include <type_traits>
 #include <utility>
+#include <version>
+
+#if defined(__cpp_lib_mdspan)
+    #include <mdspan>
+#endif
 
 namespace mwl {
 
@@ -73,22 +82,135 @@ namespace mwl {
         }
     };
 
+    enum class PixelFormat : uint8_t
+    {
+        XRGB8888,
+        ARGB8888,
+        RGB565,
+        XRGB2101010,
+        ARGB2101010,
+    };
+
+    [[nodiscard]]
+    constexpr auto bytes_per_pixel(PixelFormat format) noexcept -> int32_t
+    {
+        return format == PixelFormat::RGB565 ? 2 : 4;
+    }
+
+    struct Event;
+
+    enum class EventLoop : uint8_t
+    {
+        Poll,
+
+        // Waits for events through an io_uring, requires MWL_USE_IO_URING and falls back to Poll otherwise
+        IoUring,
+    };
+
+    // A display connected to the system, the strings stay valid until events are dispatched again
+    struct Output
+    {
+        std::string_view name;
+        std::string_view description;
+        std::string_view make;
+        std::string_view model;
+    };
+
+    // Where State::create spent its time, phases a backend doesn't have are zero
+    struct StartupProfile
+    {
+        // Opening the connection to the display server
+        std::chrono::nanoseconds connect;
+
+        // Waiting for the display server to announce its globals and binding the ones that are always needed
+        std::chrono::nanoseconds globals;
+
+        // Everything else the backend sets up, e.g keymaps, timers and the input thread
+        std::chrono::nanoseconds setup;
+
+        // All of State::create, including the phases above
+        std::chrono::nanoseconds total;
+    };
+
     struct State : Handle<State>
     {
         struct Desc
         {
             ClientAPI client_api{};
+
+            // Only affects how dispatch_events waits, external event loops wait on the fds themselves
+            EventLoop event_loop = EventLoop::Poll;
+
+            // Reads input on a dedicated thread so it doesn't wait for the thread calling dispatch_events
+            // to finish rendering. Events are queued and the callbacks still run from dispatch_events.
+            bool threaded_input = false;
+
+            // When non-zero, window events are also queued in a ring of (at least) this many entries,
+            // to be retrieved with poll_events. Callbacks still run for events that have one set.
+            uint32_t event_queue_capacity = 0;
+
+            // Worker threads used by ScreenBuffer::for_each_tile, 0 picks one per hardware thread
+            // besides the calling thread. The workers are only started once they're first needed.
+            uint32_t worker_thread_count = 0;
         };
 
         [[nodiscard]]
         static auto create(Desc desc) -> State;
         void destroy();
 
+        // Blocks until events arrive, then dispatches them
         void dispatch_events() const;
 
+        // Waits at most `timeout` for events to arrive, then dispatches everything that's available.
+        // Returns true if any events were dispatched.
+        auto dispatch_events(std::chrono::milliseconds timeout) const -> bool;
+
+        // Dispatches the events that have already arrived without waiting for new ones.
+        // Returns true if any events were dispatched.
+        auto dispatch_pending() const -> bool;
+
+        // Moves up to events.size() queued events into `events`, oldest first, and returns how many were written.
+        // Only dispatched events are queued, so call one of the dispatch functions first.
+        // Requires Desc::event_queue_capacity, if the queue fills up newer events are dropped.
+        [[nodiscard]] auto poll_events(std::span<Event> events) const -> size_t;
+
+        // Integration with external event loops (e.g epoll). Wait for connection_fd() and internal_fds()
+        // to become readable alongside your own fds, following the same protocol as wl_display_prepare_read:
+        //
+        //     while (!state.prepare_read()) state.dispatch_pending();
+        //     state.flush();
+        //     epoll_wait(...);
+        //     connection_fd_readable ? state.read_events() : state.cancel_read();
+        //     state.dispatch_pending();
+        //
+        // dispatch_pending also services the internal fds (e.g key repeat timers).
+        // Win32 has no fds to wait on, connection_fd returns -1 there.
+        [[nodiscard]] auto connection_fd() const -> int32_t;
+        [[nodiscard]] auto internal_fds() const -> std::span<const int32_t>;
+
+        // Returns false if events are already queued, dispatch those first and try again
+        [[nodiscard]] auto prepare_read() const -> bool;
+        auto read_events() const -> bool;
+        void cancel_read() const;
+
+        // Returns false if not all requests could be written, wait for connection_fd to become writable and retry
+        auto flush() const -> bool;
+
         [[nodiscard]]
         auto client_api() const noexcept -> ClientAPI;
 
+        // XRGB8888 is supported everywhere, other formats depend on the compositor
+        [[nodiscard]]
+        auto is_pixel_format_supported(PixelFormat format) const -> bool;
+
+        [[nodiscard]]
+        auto startup_profile() const -> StartupProfile;
+
+        // Writes up to outputs.size() outputs into `outputs` and returns how many were written.
+        // Outputs aren't tracked until this is first called, which waits for the display server once.
+        // Win32 doesn't report any outputs yet.
+        [[nodiscard]] auto get_outputs(std::span<Output> outputs) const -> size_t;
+
         template<typename T>
         [[nodiscard]]
         auto get_underlying_resource() const -> T*
@@ -101,12 +223,126 @@ namespace mwl {
         auto get_underlying_resource_impl(UnderlyingResourceID id) const -> void*;
     };
 
+    struct Rect
+    {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    void report_out_of_bounds_access(int32_t x, int32_t y, int32_t width, int32_t height);
+
+    // Non-owning 2D view of the pixels in a ScreenBuffer. Rows are `stride` pixels apart, which may be more
+    // than `width` since rows are padded to the cache line size. Bounds checks are compiled out when
+    // MWL_DISABLE_BOUNDS_CHECKS is defined, letting row-major loops over a view vectorize.
+    template<typename Pixel>
+    struct BasicPixelView
+    {
+        Pixel* data = nullptr;
+        int32_t width = 0;
+        int32_t height = 0;
+        int32_t stride = 0;
+
+        [[nodiscard]]
+        auto row(int32_t y) const -> std::span<Pixel>
+        {
+            check_bounds(0, y);
+            return { data + static_cast<size_t>(y) * stride, static_cast<size_t>(width) };
+        }
+
+        [[nodiscard]]
+        auto operator[](int32_t x, int32_t y) const -> Pixel&
+        {
+            check_bounds(x, y);
+            return data[static_cast<size_t>(y) * stride + x];
+        }
+
+    #if defined(__cpp_lib_mdspan)
+        // Follows the usual mdspan convention of being indexed as [y, x]
+        [[nodiscard]]
+        auto to_mdspan() const -> std::mdspan<Pixel, std::dextents<size_t, 2>, std::layout_stride>
+        {
+            using Extents = std::dextents<size_t, 2>;
+            const auto mapping = std::layout_stride::mapping<Extents> {
+                Extents { static_cast<size_t>(height), static_cast<size_t>(width) },
+                std::array<size_t, 2> { static_cast<size_t>(stride), 1 }
+            };
+            return { data, mapping };
+        }
+    #endif
+
+    private:
+        void check_bounds([[maybe_unused]] int32_t x, [[maybe_unused]] int32_t y) const
+        {
+        #if !defined(MWL_DISABLE_BOUNDS_CHECKS)
+            if (x < 0 || y < 0 || x >= width || y >= height) [[unlikely]]
+            {
+                report_out_of_bounds_access(x, y, width, height);
+            }
+        #endif
+        }
+    };
+
+    using PixelView = BasicPixelView<uint32_t>;
+
     struct ScreenBuffer : Handle<ScreenBuffer>
     {
+        // Colors are given in the pixel format of the buffer, only the lower 16 bits are used for RGB565
         void fill(uint32_t color) const noexcept;
+        void fill_rect(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color) const noexcept;
+
+        // Marks a region of the buffer as changed since it was last presented. Overlapping regions are merged,
+        // and only the damaged regions are sent to the compositor. A buffer without damage is presented in full.
+        void add_damage(int32_t x, int32_t y, int32_t width, int32_t height) const;
 
+        [[nodiscard]]
+        auto damage() const noexcept -> std::span<const Rect>;
+
+        // Number of frames since the contents of this buffer were presented, same as EGL_EXT_buffer_age.
+        // An age of 1 means the buffer holds the previous frame, 0 means the contents are undefined.
+        [[nodiscard]]
+        auto age() const noexcept -> uint32_t;
+
+        [[nodiscard]] auto width() const noexcept -> int32_t;
+        [[nodiscard]] auto height() const noexcept -> int32_t;
+        [[nodiscard]] auto pixel_format() const noexcept -> PixelFormat;
+
+        // Distance between the start of two rows, in bytes
+        [[nodiscard]] auto stride() const noexcept -> int32_t;
+
+        // Pixel has to match the size of the pixel format, e.g uint16_t for RGB565.
+        // Returns an empty view if it doesn't.
+        template<typename Pixel = uint32_t>
+        [[nodiscard]]
+        auto view() const noexcept -> BasicPixelView<Pixel>
+        {
+            auto* data = static_cast<Pixel*>(view_data(sizeof(Pixel)));
+
+            if (!data)
+            {
+                return {};
+            }
+
+            return { data, width(), height(), stride() / static_cast<int32_t>(sizeof(Pixel)) };
+        }
+
+        static constexpr int32_t DefaultTileSize = 64;
+
+        // Splits the buffer into tiles of at most tile_width x tile_height pixels and invokes the callback for
+        // each of them, spread across the worker threads of the State the buffer was fetched from.
+        // The calling thread takes part as well, and the function returns once every tile has been processed.
+        using TileCallback = std::function<void(Rect)>;
+        void for_each_tile(int32_t tile_width, int32_t tile_height, const TileCallback& callback) const;
+        void for_each_tile(const TileCallback& callback) const;
+
+        // Indexes the underlying pixel storage of 32-bit formats directly, rows are stride() / 4 pixels apart
         [[nodiscard]]
         auto operator[](size_t idx) const -> uint32_t&;
+
+    private:
+        [[nodiscard]]
+        auto view_data(size_t pixel_size) const noexcept -> void*;
     };
 
     enum class ButtonState : uint8_t
@@ -125,16 +361,58 @@ namespace mwl {
         Wheel, Finger, Continuous, WheelTilt
     };
 
+    struct SizeEvent
+    {
+        // Logical size of the window
+        int32_t width;
+        int32_t height;
+
+        // Size of the buffers returned by fetch_screen_buffer before any render scale is applied
+        int32_t physical_width;
+        int32_t physical_height;
+
+        float scale;
+    };
+
+    // When the input device generated an event, as time since the steady_clock epoch. On Linux steady_clock is
+    // CLOCK_MONOTONIC, so steady_clock::time_point(timestamp) can be compared with steady_clock::now() directly
+    // (e.g to measure input-to-photon latency). A duration rather than a time_point keeps events trivially constructible.
+    using EventTimestamp = std::chrono::nanoseconds;
+
     struct MouseMotionEvent
     {
         int32_t x;
         int32_t y;
+
+        // Movement since the previous motion event, covers every merged sample when coalescing
+        int32_t delta_x;
+        int32_t delta_y;
+
+        // Timestamp of the latest sample when coalescing
+        EventTimestamp timestamp;
+    };
+
+    enum class MotionCoalescing : uint8_t
+    {
+        // Every motion sample is delivered on its own
+        Off,
+
+        // Samples are merged into a single event per dispatch carrying the latest position and the total delta
+        Latest,
+
+        // Same as Latest, but the individual samples stay available through Window::motion_samples
+        Accumulate,
     };
 
     struct KeyEvent
     {
         uint32_t key;
         ButtonState state;
+
+        // Set for presses generated by key repeat while the key is held down
+        bool is_repeat;
+
+        EventTimestamp timestamp;
     };
 
     struct MouseButtonEvent
@@ -143,16 +421,18 @@ namespace mwl {
         // bit 2 -> state
         // bit 3..7 -> button
         uint8_t value;
+        EventTimestamp timestamp;
 
-        MouseButtonEvent(uint8_t button, ButtonState state)
-            : value((button << 3) | (std::to_underlying(state) << 2))
+        MouseButtonEvent() = default;
+        MouseButtonEvent(uint8_t button, ButtonState state, EventTimestamp timestamp = {})
+            : value((button << 3) | (std::to_underlying(state) << 2)), timestamp(timestamp)
         {
         }
 
         [[nodiscard]]
         auto state() const noexcept -> ButtonState
         {
-            return static_cast<ButtonState>(value & 0b100);
+            return static_cast<ButtonState>((value >> 2) & 0b1);
         }
 
         [[nodiscard]]
@@ -168,9 +448,11 @@ namespace mwl {
         // bit 2    -> axis
         // bit 3..7 -> value [-8..8]
         int8_t storage;
+        EventTimestamp timestamp;
 
-        MouseScrollEvent(ScrollAxis axis, ScrollSource source, int8_t value)
-            : storage((value << 3) | (std::to_underlying(axis) << 2) | std::to_underlying(source))
+        MouseScrollEvent() = default;
+        MouseScrollEvent(ScrollAxis axis, ScrollSource source, int8_t value, EventTimestamp timestamp = {})
+            : storage((value << 3) | (std::to_underlying(axis) << 2) | std::to_underlying(source)), timestamp(timestamp)
         {
         }
 
@@ -194,22 +476,140 @@ namespace mwl {
 
     };
 
+    // Snapshot of the input state of a window, see Window::input_state
+    struct InputState
+    {
+        // Covers the MWL_KEY_* range
+        static constexpr uint32_t KeyCount = 384;
+
+        std::array<uint64_t, KeyCount / 64> keys;
+
+        // Bit n is set while MWL_BUTTON_n is held down
+        uint32_t buttons;
+
+        int32_t x;
+        int32_t y;
+
+        // Sum of the values of every scroll event so far, consumers compare against the previous snapshot
+        int32_t scroll_x;
+        int32_t scroll_y;
+
+        uint32_t padding;
+
+        [[nodiscard]]
+        auto is_key_down(uint32_t key) const noexcept -> bool
+        {
+            return key < KeyCount && (keys[key / 64] >> (key % 64)) & 1;
+        }
+
+        [[nodiscard]]
+        auto is_button_down(uint32_t button) const noexcept -> bool
+        {
+            return button < 32 && (buttons >> button) & 1;
+        }
+    };
+
+    // Non-owning reference to an object handling input events, see Window::set_input_listener.
+    // Each handler is a plain function pointer that calls the listener's member function directly.
+    struct InputListener
+    {
+        void* object = nullptr;
+        void (*on_key)(void* object, KeyEvent event) = nullptr;
+        void (*on_mouse_motion)(void* object, MouseMotionEvent event) = nullptr;
+        void (*on_mouse_button)(void* object, MouseButtonEvent event) = nullptr;
+        void (*on_mouse_scroll)(void* object, MouseScrollEvent event) = nullptr;
+
+        // Picks up whichever of on_key, on_mouse_motion, on_mouse_button and on_mouse_scroll `L` has
+        template<typename L>
+        [[nodiscard]]
+        static auto bind(L& listener) noexcept -> InputListener
+        {
+            auto result = InputListener { .object = &listener };
+
+            if constexpr (requires(L& l, KeyEvent event) { l.on_key(event); })
+            {
+                result.on_key = [](void* object, KeyEvent event) { static_cast<L*>(object)->on_key(event); };
+            }
+
+            if constexpr (requires(L& l, MouseMotionEvent event) { l.on_mouse_motion(event); })
+            {
+                result.on_mouse_motion = [](void* object, MouseMotionEvent event) { static_cast<L*>(object)->on_mouse_motion(event); };
+            }
+
+            if constexpr (requires(L& l, MouseButtonEvent event) { l.on_mouse_button(event); })
+            {
+                result.on_mouse_button = [](void* object, MouseButtonEvent event) { static_cast<L*>(object)->on_mouse_button(event); };
+            }
+
+            if constexpr (requires(L& l, MouseScrollEvent event) { l.on_mouse_scroll(event); })
+            {
+                result.on_mouse_scroll = [](void* object, MouseScrollEvent event) { static_cast<L*>(object)->on_mouse_scroll(event); };
+            }
+
+            return result;
+        }
+    };
+
+    // Windows live in slab storage owned by their State. The handle remembers the generation of its slot,
+    // so a handle to a destroyed window stays detectably invalid even after the slot is reused.
     struct Window : Handle<Window>
     {
+        Window() noexcept = default;
+        Window(Impl* impl) noexcept;
+
+        // Blocks until the display server has configured the window, so its properties can be queried right away
         [[nodiscard]]
         static auto create(State state, std::string_view title, int32_t width, int32_t height) -> Window;
+
+        // Returns without waiting for the display server. The window can't be presented to and its size may still
+        // change until it's configured, which happens while dispatching events and invokes the configured callback.
+        [[nodiscard]]
+        static auto create_async(State state, std::string_view title, int32_t width, int32_t height) -> Window;
+
+        struct Desc
+        {
+            std::string_view title;
+            int32_t width;
+            int32_t height;
+        };
+
+        // Creates a window for every desc and waits for all of them to be configured at once,
+        // rather than once per window like create does. `windows` has to be as large as `descs`.
+        static void create_batch(State state, std::span<const Desc> descs, std::span<Window> windows);
+
         void destroy();
 
+        // False for default constructed handles and handles to destroyed windows
+        [[nodiscard]] auto is_valid() const noexcept -> bool;
+
+        // Always true for windows from create or create_batch
+        [[nodiscard]] auto is_configured() const -> bool;
+
+        // Invoked once the display server configured a window from create_async, not invoked for windows
+        // that were already configured when the callback was set
+        using ConfiguredCallback = std::function<void()>;
+        void set_configured_callback(ConfiguredCallback callback) const;
+
+        [[nodiscard]]
+        operator bool() const noexcept { return is_valid(); }
+
         void show() const;
 
         [[nodiscard]] auto width() const -> int32_t;
         [[nodiscard]] auto height() const -> int32_t;
         auto preferred_scaling() const -> float;
 
+        // When enabled, screen buffers are allocated at the device pixel size of the window (its logical
+        // size multiplied by preferred_scaling) so the compositor doesn't have to resample them.
+        // Requires wp_viewporter, buffers are allocated at the logical size otherwise.
+        void set_native_scaling(bool enable) const;
+        [[nodiscard]] auto physical_width() const -> int32_t;
+        [[nodiscard]] auto physical_height() const -> int32_t;
+
         using CloseCallback = std::function<void()>;
         void set_close_callback(CloseCallback handler) const;
 
-        using SizeCallback = std::function<void(int32_t, int32_t)>;
+        using SizeCallback = std::function<void(SizeEvent)>;
         void set_size_callback(SizeCallback callback) const;
 
         void set_fullscreen_state(bool fullscreen) const;
@@ -221,12 +621,73 @@ namespace mwl {
         using MouseMotionCallback = std::function<void(MouseMotionEvent)>;
         void set_mouse_motion_callback(MouseMotionCallback callback) const;
 
+        // Merges motion events that arrive during a single dispatch, useful for high polling rate mice.
+        // Pending motion is delivered before any button or scroll event so the ordering is preserved.
+        void set_motion_coalescing(MotionCoalescing coalescing) const;
+
+        // With MotionCoalescing::Accumulate, the samples merged into the last delivered motion event.
+        // Valid until the next dispatch, empty in other modes.
+        [[nodiscard]] auto motion_samples() const -> std::span<const MouseMotionEvent>;
+
         using MouseButtonCallback = std::function<void(MouseButtonEvent)>;
         void set_mouse_button_callback(MouseButtonCallback callback) const;
 
         using MouseScrollCallback = std::function<void(MouseScrollEvent)>;
         void set_mouse_scroll_callback(MouseScrollCallback callback) const;
+
+        // Alternative to the input callbacks for hot paths, nothing is allocated and handlers are called without
+        // going through std::function. The listener isn't owned, it has to outlive the window or be cleared first.
+        // Runs before the callback of the same event if both are set.
+        template<typename L>
+        void set_input_listener(L& listener) const
+        {
+            set_input_listener(InputListener::bind(listener));
+        }
+
+        void set_input_listener(InputListener listener) const;
+        void clear_input_listener() const;
+
+        // Held keys and buttons, pointer position and scroll totals as of the last dispatched event.
+        // Can be called from any thread without locking, the returned snapshot is always consistent.
+        // Held keys are cleared when the window loses keyboard focus.
+        [[nodiscard]] auto input_state() const -> InputState;
+
+        // Invoked once the compositor is ready for the next frame after a call to present_screen_buffer.
+        using FrameCallback = std::function<void()>;
+        void set_frame_callback(FrameCallback callback) const;
+
+        // Returns false while a presented frame hasn't been picked up by the compositor yet.
+        [[nodiscard]] auto is_frame_ready() const -> bool;
+
+        // Dispatches events until the compositor is ready for the next frame and returns true,
+        // or returns true immediately if no frame is pending. Compositors may stop sending frames
+        // for hidden windows, so this returns false instead once the window was asked to close.
+        auto wait_for_frame() const -> bool;
+
+        // Same as above, but also returns false once `timeout` elapsed without a frame
+        auto wait_for_frame(std::chrono::milliseconds timeout) const -> bool;
         
+        // When enabled, regions that changed since a fetched buffer was last presented are copied
+        // forward from the most recent frame. Fetched buffers then always hold the previous frame.
+        void set_preserve_screen_buffer(bool preserve) const;
+
+        // Pixel format of buffers returned by fetch_screen_buffer, defaults to XRGB8888.
+        // Formats that aren't supported by the State are rejected.
+        void set_pixel_format(PixelFormat format) const;
+        [[nodiscard]] auto pixel_format() const -> PixelFormat;
+
+        // Renders into buffers that are `scale` times the size of the window, and lets the compositor scale them
+        // back up to the window size. Clamped to [0.25, 1]. Only has an effect when the compositor
+        // supports wp_viewporter, buffers always match the window size otherwise.
+        void set_render_scale(float scale) const;
+        [[nodiscard]] auto render_scale() const -> float;
+
+        // Adjusts the render scale automatically based on the time spent between fetch_screen_buffer
+        // and present_screen_buffer, lowering it when frames take longer than `target_frame_time`
+        // and raising it again once there's headroom. A target of zero disables automatic scaling.
+        void set_automatic_render_scale(std::chrono::microseconds target_frame_time) const;
+
+        // A fetched buffer can be dropped without presenting it, the next fetch may hand it out again with an age of 0
         [[nodiscard]]
         auto fetch_screen_buffer() const -> ScreenBuffer;
         void present_screen_buffer(const ScreenBuffer buffer) const;
@@ -240,6 +701,38 @@ namespace mwl {
 
     private:
         [[nodiscard]] auto get_underlying_resource_impl(UnderlyingResourceID id) const -> void*;
+
+        uint32_t generation = 0;
     };
 
+    enum class EventType : uint8_t
+    {
+        None,
+        Close,
+        Size,
+        Key,
+        MouseMotion,
+        MouseButton,
+        MouseScroll,
+        Configured,
+    };
+
+    // Returned by State::poll_events, only the member matching `type` is valid
+    struct Event
+    {
+        EventType type;
+        Window window;
+
+        union
+        {
+            SizeEvent size;
+            KeyEvent key;
+            MouseMotionEvent mouse_motion;
+            MouseButtonEvent mouse_button;
+            MouseScrollEvent mouse_scroll;
+        };
+    };
+
+    static_assert(std::is_trivially_copyable_v<Event>);
+
 }
@@ -1,24 +1,27 @@
-#include "mwl_impl.hpp"
-
-#if defined(MWL_PLATFORM_WINDOWS)
-    #include "mwl_win32.hpp"
-#elif defined(MWL_INCLUDE_WAYLAND)
-    #include "mwl_wayland.hpp"
-#endif
+#include "mwl_backend.hpp"
+#include "mwl_fill.hpp"
 
+#include <bit>
 #include <cstring>
+#include <limits>
 #include <print>
 
 namespace mwl {
 
     auto State::create(Desc desc) -> State
     {
+        const auto start = std::chrono::steady_clock::now();
         Impl* state_impl = nullptr;
 
         #if defined(MWL_PLATFORM_WINDOWS)
 
             auto* win32_state = new Win32StateImpl();
             win32_state->desc = desc;
+            win32_state->event_queue.init(desc.event_queue_capacity);
+            win32_state->window_slab.init(sizeof(Win32WindowImpl), alignof(Win32WindowImpl));
+        #if !defined(MWL_SINGLE_BACKEND)
+            win32_state->backend = &state_backend_table<Win32StateImpl>;
+        #endif
             win32_state->init();
             state_impl = win32_state;
 
@@ -36,6 +39,11 @@ namespace mwl {
             {
                 auto* wayland_state = new WaylandStateImpl();
                 wayland_state->desc = desc;
+                wayland_state->event_queue.init(desc.event_queue_capacity);
+                wayland_state->window_slab.init(sizeof(WaylandWindowImpl), alignof(WaylandWindowImpl));
+            #if !defined(MWL_SINGLE_BACKEND)
+                wayland_state->backend = &state_backend_table<WaylandStateImpl>;
+            #endif
                 wayland_state->init();
                 state_impl = wayland_state;
                 break;
@@ -49,18 +57,104 @@ namespace mwl {
             }
         #endif
 
+        state_impl->startup_profile.total = std::chrono::steady_clock::now() - start;
         return { state_impl };
     }
 
     void State::destroy()
     {
-        delete impl;
+        impl->destroy();
         impl = nullptr;
     }
 
     void State::dispatch_events() const
     {
-        impl->dispatch_events();
+        impl->dispatch_events(-1);
+    }
+
+    auto State::dispatch_events(std::chrono::milliseconds timeout) const -> bool
+    {
+        const auto timeout_ms = std::clamp<std::chrono::milliseconds::rep>(timeout.count(), 0, std::numeric_limits<int32_t>::max());
+        return impl->dispatch_events(static_cast<int32_t>(timeout_ms));
+    }
+
+    auto State::dispatch_pending() const -> bool
+    {
+        return impl->dispatch_events(0);
+    }
+
+    void EventQueue::init(uint32_t capacity)
+    {
+        if (capacity == 0)
+        {
+            return;
+        }
+
+        // Power of two so indices wrap with a mask
+        capacity = std::bit_ceil(capacity);
+        events = std::make_unique<Event[]>(capacity);
+        mask = capacity - 1;
+    }
+
+    void EventQueue::push(const Event& event)
+    {
+        if (count > mask)
+        {
+            return;
+        }
+
+        events[(head + count) & mask] = event;
+        ++count;
+    }
+
+    auto EventQueue::pop(std::span<Event> out) -> size_t
+    {
+        const auto popped = std::min<size_t>(out.size(), count);
+
+        for (size_t i = 0; i < popped; ++i)
+        {
+            out[i] = events[(head + i) & mask];
+        }
+
+        head = (head + popped) & mask;
+        count -= static_cast<uint32_t>(popped);
+        return popped;
+    }
+
+    auto State::poll_events(std::span<Event> events) const -> size_t
+    {
+        MWL_VERIFY(impl->event_queue.is_enabled(), "poll_events requires State::Desc::event_queue_capacity to be set", size_t{});
+        return impl->event_queue.pop(events);
+    }
+
+    auto State::connection_fd() const -> int32_t
+    {
+        return impl->connection_fd();
+    }
+
+    auto State::internal_fds() const -> std::span<const int32_t>
+    {
+        return impl->internal_fds();
+    }
+
+    auto State::prepare_read() const -> bool
+    {
+        return impl->prepare_read();
+    }
+
+    auto State::read_events() const -> bool
+    {
+        return impl->read_events();
+    }
+
+    void State::cancel_read() const
+    {
+        impl->cancel_read();
+    }
+
+    auto State::flush() const -> bool
+    {
+        return impl->flush();
     }
 
     auto State::client_api() const noexcept -> ClientAPI
@@ -68,36 +162,259 @@ namespace mwl {
         return impl->desc.client_api;
     }
 
+    auto State::is_pixel_format_supported(PixelFormat format) const -> bool
+    {
+        return impl->is_pixel_format_supported(format);
+    }
+
+    auto State::startup_profile() const -> StartupProfile
+    {
+        return impl->startup_profile;
+    }
+
+    auto State::get_outputs(std::span<Output> outputs) const -> size_t
+    {
+        return impl->get_outputs(outputs);
+    }
+
     auto State::get_underlying_resource_impl(UnderlyingResourceID id) const -> void*
     {
         return impl->get_underlying_resource(id);
     }
 
+    auto State::Impl::get_thread_pool() -> ThreadPool&
+    {
+        if (!thread_pool)
+        {
+            auto worker_count = desc.worker_thread_count;
+
+            if (worker_count == 0)
+            {
+                worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+            }
+
+            thread_pool = std::make_unique<ThreadPool>();
+            thread_pool->init(worker_count);
+        }
+
+        return *thread_pool;
+    }
+
+    static void fill_pixel_region(ScreenBuffer::Impl* impl, int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color)
+    {
+        const auto pixel_size = bytes_per_pixel(impl->pixel_format);
+        auto* region = impl->pixel_buffer + static_cast<size_t>(y) * impl->stride + static_cast<size_t>(x) * pixel_size;
+
+        if (pixel_size == static_cast<int32_t>(sizeof(uint16_t)))
+        {
+            fill_pixels(reinterpret_cast<uint16_t*>(region), impl->stride / sizeof(uint16_t), width, height, static_cast<uint16_t>(color));
+        }
+        else
+        {
+            fill_pixels(reinterpret_cast<uint32_t*>(region), impl->stride / sizeof(uint32_t), width, height, color);
+        }
+    }
+
     void ScreenBuffer::fill(uint32_t color) const noexcept
     {
-        MWL_VERIFY(impl, "Trying to fill an empty ScreenBuffer");
-        std::fill_n(impl->pixel_buffer, impl->pixel_buffer_size / sizeof(uint32_t), color);
+        MWL_VERIFY(impl, "Trying to fill an empty ScreenBuffer", void_t{});
+        fill_pixel_region(impl, 0, 0, impl->width, impl->height, color);
+    }
+
+    void ScreenBuffer::fill_rect(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t color) const noexcept
+    {
+        MWL_VERIFY(impl, "Trying to fill an empty ScreenBuffer", void_t{});
+
+        const auto x0 = std::max(x, 0);
+        const auto y0 = std::max(y, 0);
+        const auto x1 = std::min(x + width, impl->width);
+        const auto y1 = std::min(y + height, impl->height);
+
+        if (x1 <= x0 || y1 <= y0)
+        {
+            return;
+        }
+
+        fill_pixel_region(impl, x0, y0, x1 - x0, y1 - y0, color);
+    }
+
+    // Past this point we stop tracking individual regions and damage their bounding box instead
+    static constexpr size_t MaxDamageRects = 16;
+
+    static auto rects_overlap(const Rect& a, const Rect& b) -> bool
+    {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    static auto rect_union(const Rect& a, const Rect& b) -> Rect
+    {
+        const auto x0 = std::min(a.x, b.x);
+        const auto y0 = std::min(a.y, b.y);
+        const auto x1 = std::max(a.x + a.width, b.x + b.width);
+        const auto y1 = std::max(a.y + a.height, b.y + b.height);
+        return { x0, y0, x1 - x0, y1 - y0 };
+    }
+
+    void ScreenBuffer::add_damage(int32_t x, int32_t y, int32_t width, int32_t height) const
+    {
+        MWL_VERIFY(impl, "Trying to add damage to an empty ScreenBuffer", void_t{});
+
+        const auto x0 = std::max(x, 0);
+        const auto y0 = std::max(y, 0);
+        const auto x1 = std::min(x + width, impl->width);
+        const auto y1 = std::min(y + height, impl->height);
+
+        if (x1 <= x0 || y1 <= y0)
+        {
+            return;
+        }
+
+        auto rect = Rect { x0, y0, x1 - x0, y1 - y0 };
+        auto& damage = impl->damage;
+
+        // Merging can grow the rect into regions it didn't overlap before, so restart the scan after every merge
+        for (auto it = damage.begin(); it != damage.end();)
+        {
+            if (rects_overlap(*it, rect))
+            {
+                rect = rect_union(*it, rect);
+                damage.erase(it);
+                it = damage.begin();
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (damage.size() >= MaxDamageRects)
+        {
+            for (const auto& other : damage)
+            {
+                rect = rect_union(other, rect);
+            }
+
+            damage.clear();
+        }
+
+        damage.push_back(rect);
+    }
+
+    auto ScreenBuffer::damage() const noexcept -> std::span<const Rect>
+    {
+        return impl->damage;
+    }
+
+    void ScreenBuffer::for_each_tile(int32_t tile_width, int32_t tile_height, const TileCallback& callback) const
+    {
+        MWL_VERIFY(impl, "Trying to iterate the tiles of an empty ScreenBuffer", void_t{});
+        MWL_VERIFY(tile_width > 0 && tile_height > 0, "Tile size has to be positive", void_t{});
+
+        struct TileJob
+        {
+            int32_t buffer_width;
+            int32_t buffer_height;
+            int32_t tile_width;
+            int32_t tile_height;
+            int32_t tiles_x;
+            const TileCallback* callback;
+        };
+
+        const auto tiles_x = (impl->width + tile_width - 1) / tile_width;
+        const auto tiles_y = (impl->height + tile_height - 1) / tile_height;
+
+        auto job = TileJob { impl->width, impl->height, tile_width, tile_height, tiles_x, &callback };
+
+        // Tiles are numbered row by row, so the contiguous index ranges handed to each thread
+        // cover neighbouring tiles
+        impl->state->get_thread_pool().parallel_for(static_cast<uint32_t>(tiles_x * tiles_y), [](void* data, uint32_t index)
+        {
+            const auto& job = *static_cast<const TileJob*>(data);
+            const auto x = static_cast<int32_t>(index) % job.tiles_x * job.tile_width;
+            const auto y = static_cast<int32_t>(index) / job.tiles_x * job.tile_height;
+
+            (*job.callback)(Rect {
+                x, y,
+                std::min(job.tile_width, job.buffer_width - x),
+                std::min(job.tile_height, job.buffer_height - y)
+            });
+        }, &job);
+    }
+
+    void ScreenBuffer::for_each_tile(const TileCallback& callback) const
+    {
+        for_each_tile(DefaultTileSize, DefaultTileSize, callback);
+    }
+
+    auto ScreenBuffer::age() const noexcept -> uint32_t
+    {
+        return impl->age;
+    }
+
+    auto ScreenBuffer::width() const noexcept -> int32_t
+    {
+        return impl->width;
+    }
+
+    auto ScreenBuffer::height() const noexcept -> int32_t
+    {
+        return impl->height;
+    }
+
+    auto ScreenBuffer::pixel_format() const noexcept -> PixelFormat
+    {
+        return impl->pixel_format;
+    }
+
+    auto ScreenBuffer::stride() const noexcept -> int32_t
+    {
+        return impl->stride;
+    }
+
+    auto ScreenBuffer::view_data(size_t pixel_size) const noexcept -> void*
+    {
+        MWL_VERIFY(impl, "Trying to view an empty ScreenBuffer", nullptr);
+        MWL_VERIFY(
+            pixel_size == static_cast<size_t>(bytes_per_pixel(impl->pixel_format)),
+            std::format("Trying to view a ScreenBuffer with {} byte pixels as {} byte pixels", bytes_per_pixel(impl->pixel_format), pixel_size),
+            nullptr);
+        return impl->pixel_buffer;
     }
 
     auto ScreenBuffer::operator[](size_t idx) const -> uint32_t&
     {
+    #if !defined(MWL_DISABLE_BOUNDS_CHECKS)
         MWL_VERIFY(impl, "Trying to index into an empty ScreenBuffer");
-        MWL_VERIFY(idx < impl->pixel_buffer_size, std::format("Trying to access ScreenBuffer out of range. idx = {}, size = {}", idx, impl->pixel_buffer_size));
-        return impl->pixel_buffer[idx];
+        MWL_VERIFY(bytes_per_pixel(impl->pixel_format) == static_cast<int32_t>(sizeof(uint32_t)), "Trying to index into a ScreenBuffer with 16-bit pixels");
+
+        const auto pixel_count = impl->pixel_buffer_size / sizeof(uint32_t);
+        MWL_VERIFY(idx < pixel_count, std::format("Trying to access ScreenBuffer out of range. idx = {}, size = {}", idx, pixel_count));
+    #endif
+
+        return reinterpret_cast<uint32_t*>(impl->pixel_buffer)[idx];
     }
 
-    auto Window::create(State state, std::string_view title, int32_t width, int32_t height) -> Window
+    void report_out_of_bounds_access(int32_t x, int32_t y, int32_t width, int32_t height)
+    {
+        MWL_VERIFY(false, std::format("Trying to access pixel ({}, {}) in a {}x{} view", x, y, width, height));
+    }
+
+    // Sends the requests creating the window, without waiting for the display server to configure it
+    static auto create_window_impl(State state, std::string_view title, int32_t width, int32_t height) -> Window::Impl*
     {
-        Impl* window_impl = nullptr;
+        Window::Impl* window_impl = nullptr;
 
         #if defined(MWL_PLATFORM_WINDOWS)
 
-            auto* win32_window = new Win32WindowImpl();
+            auto* win32_window = new (state->window_slab.allocate()) Win32WindowImpl();
             win32_window->state = state;
             win32_window->title = title;
             win32_window->width = width;
             win32_window->height = height;
             win32_window->preferred_scaling = 1.0f;
+        #if !defined(MWL_SINGLE_BACKEND)
+            win32_window->backend = &window_backend_table<Win32WindowImpl>;
+        #endif
             win32_window->init();
             window_impl = win32_window;
 
@@ -107,12 +424,15 @@ namespace mwl {
             #if defined(MWL_INCLUDE_WAYLAND)
             case ClientAPI::Wayland:
             {
-                auto* wayland_window = new WaylandWindowImpl();
+                auto* wayland_window = new (state->window_slab.allocate()) WaylandWindowImpl();
                 wayland_window->state = state;
                 wayland_window->title = title;
                 wayland_window->width = width;
                 wayland_window->height = height;
                 wayland_window->preferred_scaling = 1.0f;
+            #if !defined(MWL_SINGLE_BACKEND)
+                wayland_window->backend = &window_backend_table<WaylandWindowImpl>;
+            #endif
                 wayland_window->init();
                 window_impl = wayland_window;
                 break;
@@ -121,20 +441,61 @@ namespace mwl {
             default:
             {
                 std::println("Unable to create mwl::Window with ClientAPI {}.", static_cast<int32_t>(state->desc.client_api));
-                return {};
+                return nullptr;
             }
             }
         #endif
 
+        return window_impl;
+    }
+
+    auto Window::create(State state, std::string_view title, int32_t width, int32_t height) -> Window
+    {
+        auto* window_impl = create_window_impl(state, title, width, height);
+
+        if (window_impl)
+        {
+            state->roundtrip();
+        }
+
         return { window_impl };
     }
 
+    auto Window::create_async(State state, std::string_view title, int32_t width, int32_t height) -> Window
+    {
+        return { create_window_impl(state, title, width, height) };
+    }
+
+    void Window::create_batch(State state, std::span<const Desc> descs, std::span<Window> windows)
+    {
+        MWL_VERIFY(windows.size() >= descs.size(), "Not enough room for the created windows", void_t{});
+
+        for (size_t i = 0; i < descs.size(); ++i)
+        {
+            windows[i] = { create_window_impl(state, descs[i].title, descs[i].width, descs[i].height) };
+        }
+
+        state->roundtrip();
+    }
+
+    Window::Window(Impl* impl) noexcept
+        : Handle(impl), generation(impl ? Slab::generation(impl) : 0)
+    {
+    }
+
     void Window::destroy()
     {
-        delete impl;
+        MWL_VERIFY(is_valid(), "Trying to destroy an invalid Window", void_t{});
+
+        impl->destroy();
         impl = nullptr;
     }
 
+    auto Window::is_valid() const noexcept -> bool
+    {
+        return impl && Slab::generation(impl) == generation;
+    }
+
     void Window::show() const
     {
         impl->show();
@@ -155,6 +516,31 @@ namespace mwl {
         return impl->preferred_scaling;
     }
 
+    void Window::set_native_scaling(bool enable) const
+    {
+        if (impl->native_scaling == enable)
+        {
+            return;
+        }
+
+        impl->native_scaling = enable;
+
+        if (impl->supports_buffer_scaling)
+        {
+            impl->emit_size_event();
+        }
+    }
+
+    auto Window::physical_width() const -> int32_t
+    {
+        return impl->physical_width();
+    }
+
+    auto Window::physical_height() const -> int32_t
+    {
+        return impl->physical_height();
+    }
+
     void Window::set_close_callback(CloseCallback handler) const
     {
         impl->close_callback = std::move(handler);
@@ -190,19 +576,374 @@ namespace mwl {
         impl->mouse_scroll_callback = std::move(callback);
     }
 
+    void Window::set_input_listener(InputListener listener) const
+    {
+        impl->input_listener = listener;
+    }
+
+    void Window::clear_input_listener() const
+    {
+        impl->input_listener = {};
+    }
+
+    auto Window::input_state() const -> InputState
+    {
+        return impl->input_state.read();
+    }
+
     auto Window::is_fullscreen() const -> bool
     {
         return impl->is_fullscreen;
     }
 
+    void Window::set_motion_coalescing(MotionCoalescing coalescing) const
+    {
+        impl->flush_motion_event();
+        impl->motion.coalescing = coalescing;
+        impl->motion.samples.clear();
+
+        if (coalescing == MotionCoalescing::Accumulate)
+        {
+            // High polling rate mice easily produce dozens of samples per frame, avoid growing the buffer while dispatching
+            impl->motion.samples.reserve(64);
+        }
+    }
+
+    auto Window::motion_samples() const -> std::span<const MouseMotionEvent>
+    {
+        return impl->motion.samples;
+    }
+
+    auto Window::is_configured() const -> bool
+    {
+        return impl->is_configured;
+    }
+
+    void Window::set_configured_callback(ConfiguredCallback callback) const
+    {
+        impl->configured_callback = std::move(callback);
+    }
+
+    void Window::set_frame_callback(FrameCallback callback) const
+    {
+        impl->frame_callback = std::move(callback);
+    }
+
+    auto Window::is_frame_ready() const -> bool
+    {
+        return !impl->is_frame_pending;
+    }
+
+    auto Window::wait_for_frame() const -> bool
+    {
+        return impl->wait_for_frame(-1);
+    }
+
+    auto Window::wait_for_frame(std::chrono::milliseconds timeout) const -> bool
+    {
+        const auto timeout_ms = std::clamp<std::chrono::milliseconds::rep>(timeout.count(), 0, std::numeric_limits<int32_t>::max());
+        return impl->wait_for_frame(static_cast<int32_t>(timeout_ms));
+    }
+
+    void Window::set_preserve_screen_buffer(bool preserve) const
+    {
+        impl->preserve_screen_buffer = preserve;
+    }
+
+    void Window::set_pixel_format(PixelFormat format) const
+    {
+        MWL_VERIFY(impl->state->is_pixel_format_supported(format), "Pixel format isn't supported", void_t{});
+        impl->pixel_format = format;
+    }
+
+    auto Window::pixel_format() const -> PixelFormat
+    {
+        return impl->pixel_format;
+    }
+
+    void Window::Impl::emit_close_event()
+    {
+        is_close_requested = true;
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::Close, .window = { this }, .size = {} });
+        }
+
+        if (close_callback)
+        {
+            close_callback();
+        }
+    }
+
+    void Window::Impl::emit_size_event()
+    {
+        const auto event = SizeEvent { width, height, physical_width(), physical_height(), preferred_scaling };
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::Size, .window = { this }, .size = event });
+        }
+
+        if (size_callback)
+        {
+            size_callback(event);
+        }
+    }
+
+    void Window::Impl::emit_configured_event()
+    {
+        if (is_configured)
+        {
+            return;
+        }
+
+        is_configured = true;
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::Configured, .window = { this }, .size = {} });
+        }
+
+        if (configured_callback)
+        {
+            configured_callback();
+        }
+    }
+
+    void Window::Impl::emit_key_event(KeyEvent event)
+    {
+        if (event.key < InputState::KeyCount)
+        {
+            auto& word = input_state.current.keys[event.key / 64];
+            const auto bit = uint64_t(1) << (event.key % 64);
+            word = event.state == ButtonState::Pressed ? word | bit : word & ~bit;
+            input_state.publish();
+        }
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::Key, .window = { this }, .key = event });
+        }
+
+        if (input_listener.on_key)
+        {
+            input_listener.on_key(input_listener.object, event);
+        }
+
+        if (key_callback)
+        {
+            key_callback(event);
+        }
+    }
+
+    void Window::Impl::emit_mouse_motion_event(MouseMotionEvent event)
+    {
+        event.delta_x = motion.has_position ? event.x - motion.x : 0;
+        event.delta_y = motion.has_position ? event.y - motion.y : 0;
+        motion.has_position = true;
+        motion.x = event.x;
+        motion.y = event.y;
+
+        // The polled state always has the latest position, even while the event itself is coalesced
+        input_state.current.x = event.x;
+        input_state.current.y = event.y;
+        input_state.publish();
+
+        if (motion.coalescing == MotionCoalescing::Off)
+        {
+            if (state->event_queue.is_enabled())
+            {
+                state->event_queue.push({ .type = EventType::MouseMotion, .window = { this }, .mouse_motion = event });
+            }
+
+            if (input_listener.on_mouse_motion)
+            {
+                input_listener.on_mouse_motion(input_listener.object, event);
+            }
+
+            if (mouse_motion_callback)
+            {
+                mouse_motion_callback(event);
+            }
+
+            return;
+        }
+
+        if (motion.is_pending)
+        {
+            motion.pending.x = event.x;
+            motion.pending.y = event.y;
+            motion.pending.delta_x += event.delta_x;
+            motion.pending.delta_y += event.delta_y;
+            motion.pending.timestamp = event.timestamp;
+        }
+        else
+        {
+            motion.pending = event;
+            motion.is_pending = true;
+        }
+
+        if (motion.coalescing == MotionCoalescing::Accumulate)
+        {
+            if (motion.are_samples_delivered)
+            {
+                motion.samples.clear();
+                motion.are_samples_delivered = false;
+            }
+
+            motion.samples.push_back(event);
+        }
+    }
+
+    void Window::Impl::flush_motion_event()
+    {
+        if (!motion.is_pending)
+        {
+            return;
+        }
+
+        motion.is_pending = false;
+        motion.are_samples_delivered = true;
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::MouseMotion, .window = { this }, .mouse_motion = motion.pending });
+        }
+
+        if (input_listener.on_mouse_motion)
+        {
+            input_listener.on_mouse_motion(input_listener.object, motion.pending);
+        }
+
+        if (mouse_motion_callback)
+        {
+            mouse_motion_callback(motion.pending);
+        }
+    }
+
+    void Window::Impl::clear_held_keys()
+    {
+        input_state.current.keys = {};
+        input_state.publish();
+    }
+
+    void Window::Impl::emit_mouse_button_event(MouseButtonEvent event)
+    {
+        flush_motion_event();
+
+        auto& buttons = input_state.current.buttons;
+        const auto bit = uint32_t(1) << event.button();
+        buttons = event.state() == ButtonState::Pressed ? buttons | bit : buttons & ~bit;
+        input_state.publish();
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::MouseButton, .window = { this }, .mouse_button = event });
+        }
+
+        if (input_listener.on_mouse_button)
+        {
+            input_listener.on_mouse_button(input_listener.object, event);
+        }
+
+        if (mouse_button_callback)
+        {
+            mouse_button_callback(event);
+        }
+    }
+
+    void Window::Impl::emit_mouse_scroll_event(MouseScrollEvent event)
+    {
+        flush_motion_event();
+
+        auto& scroll = event.axis() == ScrollAxis::Horizontal ? input_state.current.scroll_x : input_state.current.scroll_y;
+        scroll += event.value();
+        input_state.publish();
+
+        if (state->event_queue.is_enabled())
+        {
+            state->event_queue.push({ .type = EventType::MouseScroll, .window = { this }, .mouse_scroll = event });
+        }
+
+        if (input_listener.on_mouse_scroll)
+        {
+            input_listener.on_mouse_scroll(input_listener.object, event);
+        }
+
+        if (mouse_scroll_callback)
+        {
+            mouse_scroll_callback(event);
+        }
+    }
+
+    static constexpr float MinRenderScale = 0.25f;
+    static constexpr float RenderScaleStep = 0.1f;
+
+    // Number of frames to average before adjusting the render scale. Changing the scale reallocates
+    // the buffers of the window, so we don't want to do it every frame.
+    static constexpr uint32_t RenderScaleAdjustInterval = 30;
+
+    void Window::set_render_scale(float scale) const
+    {
+        impl->render_scale = std::clamp(scale, MinRenderScale, 1.0f);
+        impl->automatic_render_scale.target_frame_time = {};
+    }
+
+    auto Window::render_scale() const -> float
+    {
+        return impl->render_scale;
+    }
+
+    void Window::set_automatic_render_scale(std::chrono::microseconds target_frame_time) const
+    {
+        auto& scaling = impl->automatic_render_scale;
+        scaling.target_frame_time = target_frame_time;
+        scaling.accumulated_frame_time = {};
+        scaling.frame_count = 0;
+    }
+
+    static void update_automatic_render_scale(Window::Impl* impl)
+    {
+        auto& scaling = impl->automatic_render_scale;
+
+        scaling.accumulated_frame_time += std::chrono::steady_clock::now() - scaling.frame_start;
+
+        if (++scaling.frame_count < RenderScaleAdjustInterval)
+        {
+            return;
+        }
+
+        const auto average_frame_time = scaling.accumulated_frame_time / scaling.frame_count;
+
+        if (average_frame_time > scaling.target_frame_time)
+        {
+            impl->render_scale = std::max(MinRenderScale, impl->render_scale - RenderScaleStep);
+        }
+        else if (average_frame_time < scaling.target_frame_time * 3 / 4)
+        {
+            impl->render_scale = std::min(1.0f, impl->render_scale + RenderScaleStep);
+        }
+
+        scaling.accumulated_frame_time = {};
+        scaling.frame_count = 0;
+    }
+
     auto Window::fetch_screen_buffer() const -> ScreenBuffer
     {
+        impl->automatic_render_scale.frame_start = std::chrono::steady_clock::now();
         return impl->fetch_screen_buffer();
     }
 
     void Window::present_screen_buffer(const ScreenBuffer buffer) const
     {
         MWL_VERIFY(buffer.is_valid(), "Trying to present an invalid ScreenBuffer", void_t{});
+
+        if (impl->automatic_render_scale.target_frame_time.count() > 0)
+        {
+            update_automatic_render_scale(impl);
+        }
+
         impl->present_screen_buffer(buffer);
     }
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mwl_impl.hpp"
+
+#if defined(MWL_PLATFORM_WINDOWS)
+    #include "mwl_win32.hpp"
+#endif
+
+#if defined(MWL_INCLUDE_WAYLAND)
+    #include "mwl_wayland.hpp"
+#endif
+
+// Defines the forwarding functions declared by State::Impl and Window::Impl, include this instead of a backend header
+// wherever they're called.
+
+namespace mwl {
+
+#if defined(MWL_SINGLE_BACKEND)
+
+    #if defined(MWL_PLATFORM_WINDOWS)
+        using StateBackend = Win32StateImpl;
+        using WindowBackend = Win32WindowImpl;
+    #elif defined(MWL_INCLUDE_WAYLAND)
+        using StateBackend = WaylandStateImpl;
+        using WindowBackend = WaylandWindowImpl;
+    #endif
+
+    namespace detail {
+
+        struct StateBackendCheck
+        {
+            using Table = StateBackendTable;
+            using Backend = StateBackend;
+            MWL_STATE_BACKEND_FUNCTIONS(MWL_CHECK_BACKEND_FUNCTION)
+        };
+
+        struct WindowBackendCheck
+        {
+            using Table = WindowBackendTable;
+            using Backend = WindowBackend;
+            MWL_WINDOW_BACKEND_FUNCTIONS(MWL_CHECK_BACKEND_FUNCTION)
+        };
+
+    }
+
+    #define MWL_DEFINE_STATE_BACKEND_CALL(ret, name, args, ...) \
+        inline auto Handle<State>::Impl::name(__VA_ARGS__) -> ret { return static_cast<StateBackend*>(this)->name args; }
+
+    #define MWL_DEFINE_WINDOW_BACKEND_CALL(ret, name, args, ...) \
+        inline auto Handle<Window>::Impl::name(__VA_ARGS__) -> ret { return static_cast<WindowBackend*>(this)->name args; }
+
+    inline void Handle<State>::Impl::destroy()
+    {
+        delete static_cast<StateBackend*>(this);
+    }
+
+    inline void Handle<Window>::Impl::destroy()
+    {
+        destroy_in_slab(static_cast<WindowBackend*>(this), state->window_slab);
+    }
+
+#else
+
+    template<typename Backend>
+    inline constexpr auto state_backend_table = make_state_backend_table<Backend>();
+
+    template<typename Backend>
+    inline constexpr auto window_backend_table = make_window_backend_table<Backend>();
+
+    #define MWL_DEFINE_STATE_BACKEND_CALL(ret, name, args, ...) \
+        inline auto Handle<State>::Impl::name(__VA_ARGS__) -> ret { return backend->name(this MWL_BACKEND_ARGUMENTS args); }
+
+    #define MWL_DEFINE_WINDOW_BACKEND_CALL(ret, name, args, ...) \
+        inline auto Handle<Window>::Impl::name(__VA_ARGS__) -> ret { return backend->name(this MWL_BACKEND_ARGUMENTS args); }
+
+    inline void Handle<State>::Impl::destroy()
+    {
+        backend->destroy(this);
+    }
+
+    inline void Handle<Window>::Impl::destroy()
+    {
+        backend->destroy(this);
+    }
+
+#endif
+
+    MWL_STATE_BACKEND_FUNCTIONS(MWL_DEFINE_STATE_BACKEND_CALL)
+    MWL_WINDOW_BACKEND_FUNCTIONS(MWL_DEFINE_WINDOW_BACKEND_CALL)
+
+    #undef MWL_DEFINE_STATE_BACKEND_CALL
+    #undef MWL_DEFINE_WINDOW_BACKEND_CALL
+
+}
@@ -0,0 +1,207 @@
+#include "mwl_fill.hpp"
+
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define MWL_FILL_X86
+    #include <immintrin.h>
+#endif
+
+namespace mwl {
+
+    static void fill_row_scalar(uint32_t* dst, size_t count, uint32_t color)
+    {
+        std::fill_n(dst, count, color);
+    }
+
+#if defined(MWL_FILL_X86)
+
+    // Writes single pixels until dst is aligned to `Alignment` bytes, returns the number of pixels written.
+    template<size_t Alignment>
+    static auto fill_until_aligned(uint32_t*& dst, size_t count, uint32_t color) -> size_t
+    {
+        size_t written = 0;
+
+        while (written < count && (reinterpret_cast<uintptr_t>(dst) & (Alignment - 1)) != 0)
+        {
+            *dst++ = color;
+            ++written;
+        }
+
+        return written;
+    }
+
+    template<bool Streaming>
+    [[gnu::target("sse2")]]
+    static void fill_row_sse2(uint32_t* dst, size_t count, uint32_t color)
+    {
+        count -= fill_until_aligned<16>(dst, count, color);
+
+        const auto value = _mm_set1_epi32(static_cast<int32_t>(color));
+
+        for (; count >= 4; count -= 4, dst += 4)
+        {
+            if constexpr (Streaming)
+                _mm_stream_si128(reinterpret_cast<__m128i*>(dst), value);
+            else
+                _mm_store_si128(reinterpret_cast<__m128i*>(dst), value);
+        }
+
+        fill_row_scalar(dst, count, color);
+    }
+
+    template<bool Streaming>
+    [[gnu::target("avx2")]]
+    static void fill_row_avx2(uint32_t* dst, size_t count, uint32_t color)
+    {
+        count -= fill_until_aligned<32>(dst, count, color);
+
+        const auto value = _mm256_set1_epi32(static_cast<int32_t>(color));
+
+        for (; count >= 8; count -= 8, dst += 8)
+        {
+            if constexpr (Streaming)
+                _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), value);
+            else
+                _mm256_store_si256(reinterpret_cast<__m256i*>(dst), value);
+        }
+
+        fill_row_scalar(dst, count, color);
+    }
+
+    template<bool Streaming>
+    [[gnu::target("avx512f")]]
+    static void fill_row_avx512(uint32_t* dst, size_t count, uint32_t color)
+    {
+        count -= fill_until_aligned<64>(dst, count, color);
+
+        const auto value = _mm512_set1_epi32(static_cast<int32_t>(color));
+
+        for (; count >= 16; count -= 16, dst += 16)
+        {
+            if constexpr (Streaming)
+                _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), value);
+            else
+                _mm512_store_si512(reinterpret_cast<__m512i*>(dst), value);
+        }
+
+        // A single masked store takes care of the remaining 0..15 pixels
+        _mm512_mask_storeu_epi32(dst, static_cast<__mmask16>((1u << count) - 1), value);
+    }
+
+#endif
+
+    auto is_fill_kernel_supported(FillKernel kernel) noexcept -> bool
+    {
+        switch (kernel)
+        {
+            case FillKernel::Scalar: return true;
+        #if defined(MWL_FILL_X86)
+            case FillKernel::SSE2: return __builtin_cpu_supports("sse2");
+            case FillKernel::AVX2: return __builtin_cpu_supports("avx2");
+            case FillKernel::AVX512: return __builtin_cpu_supports("avx512f");
+        #endif
+            default: return false;
+        }
+    }
+
+    auto best_fill_kernel() noexcept -> FillKernel
+    {
+        static const auto kernel = []
+        {
+            for (auto kernel : { FillKernel::AVX512, FillKernel::AVX2, FillKernel::SSE2 })
+            {
+                if (is_fill_kernel_supported(kernel))
+                {
+                    return kernel;
+                }
+            }
+
+            return FillKernel::Scalar;
+        }();
+
+        return kernel;
+    }
+
+    using FillRowFn = void(*)(uint32_t*, size_t, uint32_t);
+
+    static auto select_fill_row(FillKernel kernel, bool streaming) -> FillRowFn
+    {
+        switch (kernel)
+        {
+        #if defined(MWL_FILL_X86)
+            case FillKernel::SSE2: return streaming ? fill_row_sse2<true> : fill_row_sse2<false>;
+            case FillKernel::AVX2: return streaming ? fill_row_avx2<true> : fill_row_avx2<false>;
+            case FillKernel::AVX512: return streaming ? fill_row_avx512<true> : fill_row_avx512<false>;
+        #endif
+            default: return fill_row_scalar;
+        }
+    }
+
+    void fill_pixels(FillKernel kernel, uint32_t* dst, size_t stride, size_t width, size_t height, uint32_t color, bool streaming) noexcept
+    {
+        if (width == stride)
+        {
+            // Contiguous rows, fill everything in one go
+            width *= height;
+            height = 1;
+        }
+
+        const auto fill_row = select_fill_row(kernel, streaming);
+
+        for (size_t y = 0; y < height; ++y)
+        {
+            fill_row(dst + y * stride, width, color);
+        }
+
+    #if defined(MWL_FILL_X86)
+        if (streaming && kernel != FillKernel::Scalar)
+        {
+            // Non-temporal stores are weakly ordered, make sure they're visible before anyone else reads the buffer
+            _mm_sfence();
+        }
+    #endif
+    }
+
+    void fill_pixels(uint32_t* dst, size_t stride, size_t width, size_t height, uint32_t color) noexcept
+    {
+        const auto streaming = width * height * sizeof(uint32_t) >= NonTemporalFillThreshold;
+        fill_pixels(best_fill_kernel(), dst, stride, width, height, color, streaming);
+    }
+
+    void fill_pixels(uint16_t* dst, size_t stride, size_t width, size_t height, uint16_t color) noexcept
+    {
+        const auto kernel = best_fill_kernel();
+        const auto streaming = width * height * sizeof(uint16_t) >= NonTemporalFillThreshold;
+        const auto fill_row = select_fill_row(kernel, streaming);
+        const auto pattern = (static_cast<uint32_t>(color) << 16) | color;
+
+        for (size_t y = 0; y < height; ++y)
+        {
+            auto* row = dst + y * stride;
+            auto count = width;
+
+            // Rows start on 2 byte boundaries, step forward one pixel to get to a 4 byte boundary
+            if (count > 0 && (reinterpret_cast<uintptr_t>(row) & 3) != 0)
+            {
+                *row++ = color;
+                --count;
+            }
+
+            fill_row(reinterpret_cast<uint32_t*>(row), count / 2, pattern);
+
+            if (count % 2 != 0)
+            {
+                row[count - 1] = color;
+            }
+        }
+
+    #if defined(MWL_FILL_X86)
+        if (streaming && kernel != FillKernel::Scalar)
+        {
+            _mm_sfence();
+        }
+    #endif
+    }
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mwl {
+
+    enum class FillKernel
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    // Fills larger than this bypass the cache with non-temporal stores, since we're not going
+    // to read the pixels back and would otherwise evict everything else from the cache.
+    static constexpr size_t NonTemporalFillThreshold = 1024 * 1024;
+
+    // The widest kernel supported by the CPU, detected once at runtime.
+    [[nodiscard]] auto best_fill_kernel() noexcept -> FillKernel;
+    [[nodiscard]] auto is_fill_kernel_supported(FillKernel kernel) noexcept -> bool;
+
+    // Fills `height` rows of `width` pixels each, with rows `stride` pixels apart.
+    void fill_pixels(FillKernel kernel, uint32_t* dst, size_t stride, size_t width, size_t height, uint32_t color, bool streaming) noexcept;
+
+    // Same as above but picks the kernel, and whether to stream, based on the CPU and the size of the region.
+    void fill_pixels(uint32_t* dst, size_t stride, size_t width, size_t height, uint32_t color) noexcept;
+
+    // 16-bit pixels are filled two at a time with the 32-bit kernels
+    void fill_pixels(uint16_t* dst, size_t stride, size_t width, size_t height, uint16_t color) noexcept;
+
+}
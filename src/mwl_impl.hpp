@@ -1,7 +1,14 @@
 #pragma once
 
 #include "mwl/mwl.hpp"
+#include "mwl_input_state.hpp"
+#include "mwl_slab.hpp"
+#include "mwl_thread_pool.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
 #include <print>
 #include <vector>
 #include <stacktrace>
@@ -25,63 +32,294 @@
     }\
 } while(false)
 
+// With exactly one backend compiled in, calls into it are resolved at compile time.
+// MWL_FORCE_BACKEND_TABLES dispatches through the function pointer tables regardless.
+#if defined(MWL_PLATFORM_WINDOWS)
+    #define MWL_HAS_WIN32_BACKEND 1
+#else
+    #define MWL_HAS_WIN32_BACKEND 0
+#endif
+
+#if defined(MWL_INCLUDE_WAYLAND)
+    #define MWL_HAS_WAYLAND_BACKEND 1
+#else
+    #define MWL_HAS_WAYLAND_BACKEND 0
+#endif
+
+#if MWL_HAS_WIN32_BACKEND + MWL_HAS_WAYLAND_BACKEND == 1 && !defined(MWL_FORCE_BACKEND_TABLES)
+    #define MWL_SINGLE_BACKEND
+#endif
+
 namespace mwl {
 
     using void_t = std::void_t<>;
 
-    // TODO(Peter): We shouldn't have virtual functions in Impl
-    //              instead we could store function pointers to the actual underlying
-    //              implementations. That way we avoid the vtable entirely.
-    //              It might be annoying to hook up the functions, but we could solve that
-    //              with e.g macro-iterating them.
-    //              Another alternative is rethinking using Handle at all here. There may
-    //              be a more optimal pattern available.
+    // Functions every backend implements, as X(return type, name, (arguments), parameters...).
+    // State::Impl and Window::Impl declare a non-virtual function for each of them which forwards to the backend:
+    // with a single backend compiled in that's a static_cast and a direct (inlinable) call, with multiple backends
+    // it goes through a table of function pointers picked once at creation. See mwl_backend.hpp.
+    //
+    // State:
+    //  - dispatch_events: negative timeouts wait indefinitely, returns true if any events were dispatched
+    //  - roundtrip: blocks until the display server handled every request sent so far, e.g to configure new windows
+    //  - get_outputs: fills `outputs` with as many outputs as fit and returns how many were written
+    //
+    // Window:
+    //  - wait_for_frame: negative timeouts wait indefinitely, returns true once the next frame can be drawn
+    #define MWL_STATE_BACKEND_FUNCTIONS(X) \
+        X(bool, dispatch_events, (timeout_ms), int32_t timeout_ms) \
+        X(int32_t, connection_fd, ()) \
+        X(std::span<const int32_t>, internal_fds, ()) \
+        X(bool, prepare_read, ()) \
+        X(bool, read_events, ()) \
+        X(void, cancel_read, ()) \
+        X(bool, flush, ()) \
+        X(void, roundtrip, ()) \
+        X(bool, is_pixel_format_supported, (format), PixelFormat format) \
+        X(size_t, get_outputs, (outputs), std::span<Output> outputs) \
+        X(void*, get_underlying_resource, (id), UnderlyingResourceID id)
+
+    #define MWL_WINDOW_BACKEND_FUNCTIONS(X) \
+        X(void, show, ()) \
+        X(void, set_fullscreen_state, (fullscreen), bool fullscreen) \
+        X(bool, wait_for_frame, (timeout_ms), int32_t timeout_ms) \
+        X(ScreenBuffer, fetch_screen_buffer, ()) \
+        X(void, present_screen_buffer, (buffer), ScreenBuffer buffer) \
+        X(void*, get_underlying_resource, (id), UnderlyingResourceID id)
+
+    // Turns the (arguments) of an entry into `, arguments`, to follow the self pointer in a table call
+    #define MWL_BACKEND_ARGUMENTS(...) __VA_OPT__(,) __VA_ARGS__
+
+    #define MWL_DECLARE_BACKEND_FUNCTION(ret, name, args, ...) auto name(__VA_ARGS__) -> ret;
+    #define MWL_DECLARE_BACKEND_POINTER(ret, name, args, ...) ret (*name)(Impl* self __VA_OPT__(,) __VA_ARGS__);
+    #define MWL_DEFINE_BACKEND_THUNK(ret, name, args, ...) .name = [](Table::Impl* self __VA_OPT__(,) __VA_ARGS__) -> ret { return static_cast<Backend*>(self)->name args; },
+
+    // A backend that doesn't implement a function would silently call the forwarding function again
+    #define MWL_CHECK_BACKEND_FUNCTION(ret, name, args, ...) \
+        static_assert(!std::is_same_v<decltype(&Backend::name), decltype(&Table::Impl::name)>, "Backend doesn't implement " #name);
+
+    struct StateBackendTable
+    {
+        using Impl = Handle<State>::Impl;
+
+        void (*destroy)(Impl* self);
+        MWL_STATE_BACKEND_FUNCTIONS(MWL_DECLARE_BACKEND_POINTER)
+    };
+
+    struct WindowBackendTable
+    {
+        using Impl = Handle<Window>::Impl;
+
+        void (*destroy)(Impl* self);
+        MWL_WINDOW_BACKEND_FUNCTIONS(MWL_DECLARE_BACKEND_POINTER)
+    };
+
+    // Fixed capacity ring of events for State::poll_events, allocated once when the State is created
+    struct EventQueue
+    {
+        std::unique_ptr<Event[]> events;
+        uint32_t mask = 0;
+        uint32_t head = 0;
+        uint32_t count = 0;
+
+        void init(uint32_t capacity);
+        [[nodiscard]] auto is_enabled() const noexcept -> bool { return events != nullptr; }
+        void push(const Event& event);
+        auto pop(std::span<Event> out) -> size_t;
+    };
 
     template<>
     struct Handle<State>::Impl
     {
         State::Desc desc;
+        EventQueue event_queue;
+
+        std::unique_ptr<ThreadPool> thread_pool;
+
+        // Storage for the backend Impls of every Window created with this State
+        Slab window_slab;
+
+        // Filled in by State::create and the backend's init
+        StartupProfile startup_profile{};
 
-        virtual ~Impl() = default;
-        virtual void dispatch_events() = 0;
+    #if !defined(MWL_SINGLE_BACKEND)
+        // Functions of the backend picked by State::create
+        const StateBackendTable* backend = nullptr;
+    #endif
+
+        // Lazily starts the worker threads, most applications never need them
+        auto get_thread_pool() -> ThreadPool&;
 
-        virtual auto get_underlying_resource(UnderlyingResourceID id) const -> void* = 0;
+        // Deletes the backend Impl, there's no virtual destructor
+        void destroy();
+
+        MWL_STATE_BACKEND_FUNCTIONS(MWL_DECLARE_BACKEND_FUNCTION)
     };
 
     template<>
     struct Handle<ScreenBuffer>::Impl
     {
-        uint32_t* pixel_buffer;
+        State state;
+        uint8_t* pixel_buffer;
         size_t pixel_buffer_size;
+        int32_t width;
+        int32_t height;
+
+        // In bytes
+        int32_t stride;
+        PixelFormat pixel_format;
+        uint32_t age;
+
+        // Cleared by the backend once the buffer has been presented
+        std::vector<Rect> damage;
     };
 
     template<>
     struct Handle<Window>::Impl
     {
-        virtual ~Impl() = default;
-
+        // Hot fields first, everything dispatching an event or presenting a frame touches stays
+        // within the first few cache lines. Cold fields are at the end, followed by the backend's own.
         State state;
-        std::string_view title;
+
+    #if !defined(MWL_SINGLE_BACKEND)
+        // Functions of the backend picked by Window::create
+        const WindowBackendTable* backend = nullptr;
+    #endif
+
         int32_t width;
         int32_t height;
         float preferred_scaling;
+        float render_scale = 1.0f;
+
+        bool is_fullscreen;
+        bool is_configured = false;
+        bool is_frame_pending = false;
+
+        // Set by emit_close_event, so waiting for a frame that may never come (e.g while minimized) can give up
+        bool is_close_requested = false;
+        bool preserve_screen_buffer = false;
+        bool native_scaling = false;
+
+        // Set by backends that can have the compositor scale buffers to the window size
+        bool supports_buffer_scaling = false;
+
+        PixelFormat pixel_format = PixelFormat::XRGB8888;
+
+        struct {
+            MotionCoalescing coalescing = MotionCoalescing::Off;
+
+            // Last sample received, used to compute deltas
+            bool has_position = false;
+            int32_t x;
+            int32_t y;
+
+            // Merged event waiting for flush_motion_event
+            bool is_pending = false;
+            MouseMotionEvent pending;
+
+            // Cleared lazily when the next sample arrives, so they stay valid after delivery
+            bool are_samples_delivered = false;
+            std::vector<MouseMotionEvent> samples;
+        } motion;
+
+        InputListener input_listener;
+
         Window::CloseCallback close_callback;
         Window::SizeCallback size_callback;
         Window::KeyCallback key_callback;
         Window::MouseMotionCallback mouse_motion_callback;
         Window::MouseButtonCallback mouse_button_callback;
         Window::MouseScrollCallback mouse_scroll_callback;
+        Window::FrameCallback frame_callback;
+        Window::ConfiguredCallback configured_callback;
 
-        bool is_fullscreen;
+        // Updated by the emit_* helpers below, read by Window::input_state from any thread
+        InputStateBuffer input_state;
 
-        virtual void show() = 0;
+        // Cold, only touched when the window is created or reconfigured
+        std::string_view title;
+
+        struct {
+            std::chrono::microseconds target_frame_time{};
+            std::chrono::steady_clock::time_point frame_start;
+            std::chrono::steady_clock::duration accumulated_frame_time{};
+            uint32_t frame_count = 0;
+        } automatic_render_scale;
+
+        [[nodiscard]] auto physical_width() const -> int32_t
+        {
+            return native_scaling && supports_buffer_scaling ? static_cast<int32_t>(std::lround(width * preferred_scaling)) : width;
+        }
+
+        [[nodiscard]] auto physical_height() const -> int32_t
+        {
+            return native_scaling && supports_buffer_scaling ? static_cast<int32_t>(std::lround(height * preferred_scaling)) : height;
+        }
+
+        // Size of the buffers to render into, includes the render scale
+        [[nodiscard]] auto scaled_width() const -> int32_t
+        {
+            return supports_buffer_scaling ? std::max(1, static_cast<int32_t>(std::lround(physical_width() * render_scale))) : width;
+        }
+
+        [[nodiscard]] auto scaled_height() const -> int32_t
+        {
+            return supports_buffer_scaling ? std::max(1, static_cast<int32_t>(std::lround(physical_height() * render_scale))) : height;
+        }
+
+        // Delivers motion merged by the coalescing policy, backends call this at the end of every dispatch
+        void flush_motion_event();
+
+        // Backends call this when the window loses keyboard focus, no release events are sent for held keys then
+        void clear_held_keys();
 
-        virtual void set_fullscreen_state(bool fullscreen) = 0;
+        // Hands an event to the State's event queue (if enabled) and the matching callback (if set).
+        // Backends should always go through these instead of invoking the callbacks directly.
+        // Motion events only need x and y, deltas are computed here. Only the first configured event is delivered.
+        void emit_close_event();
+        void emit_size_event();
+        void emit_configured_event();
+        void emit_key_event(KeyEvent event);
+        void emit_mouse_motion_event(MouseMotionEvent event);
+        void emit_mouse_button_event(MouseButtonEvent event);
+        void emit_mouse_scroll_event(MouseScrollEvent event);
 
-        [[nodiscard]] virtual auto fetch_screen_buffer() -> ScreenBuffer = 0;
-        virtual void present_screen_buffer(ScreenBuffer buffer) const = 0;
+        // Destroys the backend Impl and hands its slot back to the State's window_slab
+        void destroy();
 
-        virtual auto get_underlying_resource(UnderlyingResourceID id) const -> void* = 0;
+        MWL_WINDOW_BACKEND_FUNCTIONS(MWL_DECLARE_BACKEND_FUNCTION)
     };
 
+    // Grabs the slab before the object referencing it is gone
+    template<typename T>
+    void destroy_in_slab(T* object, Slab& slab)
+    {
+        std::destroy_at(object);
+        slab.deallocate(object);
+    }
+
+    template<typename Backend>
+    constexpr auto make_state_backend_table() -> StateBackendTable
+    {
+        using Table = StateBackendTable;
+        MWL_STATE_BACKEND_FUNCTIONS(MWL_CHECK_BACKEND_FUNCTION)
+
+        return {
+            .destroy = [](Table::Impl* self) { delete static_cast<Backend*>(self); },
+            MWL_STATE_BACKEND_FUNCTIONS(MWL_DEFINE_BACKEND_THUNK)
+        };
+    }
+
+    template<typename Backend>
+    constexpr auto make_window_backend_table() -> WindowBackendTable
+    {
+        using Table = WindowBackendTable;
+        MWL_WINDOW_BACKEND_FUNCTIONS(MWL_CHECK_BACKEND_FUNCTION)
+
+        return {
+            .destroy = [](Table::Impl* self) { destroy_in_slab(static_cast<Backend*>(self), self->state->window_slab); },
+            MWL_WINDOW_BACKEND_FUNCTIONS(MWL_DEFINE_BACKEND_THUNK)
+        };
+    }
+
 }
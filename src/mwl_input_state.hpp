@@ -0,0 +1,77 @@
+#pragma once
+
+#include "mwl/mwl.hpp"
+#include "mwl/mwl_input.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+
+namespace mwl {
+
+    static_assert(MWL_KEY_MENU < InputState::KeyCount);
+    static_assert(sizeof(InputState) % sizeof(uint64_t) == 0);
+
+    // Publishes InputState snapshots from the thread dispatching events to any number of reader threads.
+    // A seqlock over two slots: the writer fills the slot readers aren't looking at, so a reader only has
+    // to retry when the writer publishes twice during a single read, not on every concurrent publish.
+    // The slots are atomic words so concurrent reads and writes are well defined.
+    struct InputStateBuffer
+    {
+        static constexpr size_t WordCount = sizeof(InputState) / sizeof(uint64_t);
+        using Words = std::array<uint64_t, WordCount>;
+
+        // Writer only, the state to publish next
+        InputState current{};
+
+        // Writer only
+        void publish()
+        {
+            const auto sequence = published.load(std::memory_order_relaxed) + 1;
+
+            // Announces that the slot of `sequence - 2` is being overwritten before touching it
+            started.store(sequence, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            const auto words = std::bit_cast<Words>(current);
+            auto& slot = slots[sequence & 1];
+
+            for (size_t i = 0; i < WordCount; ++i)
+            {
+                slot[i].store(words[i], std::memory_order_relaxed);
+            }
+
+            published.store(sequence, std::memory_order_release);
+        }
+
+        [[nodiscard]] auto read() const -> InputState
+        {
+            auto words = Words{};
+
+            while (true)
+            {
+                const auto sequence = published.load(std::memory_order_acquire);
+                const auto& slot = slots[sequence & 1];
+
+                for (size_t i = 0; i < WordCount; ++i)
+                {
+                    words[i] = slot[i].load(std::memory_order_relaxed);
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                // The slot is only reused by the publish after the next one
+                if (started.load(std::memory_order_relaxed) <= sequence + 1)
+                {
+                    return std::bit_cast<InputState>(words);
+                }
+            }
+        }
+
+    private:
+        std::atomic<uint64_t> published = 0;
+        std::atomic<uint64_t> started = 0;
+        std::array<std::array<std::atomic<uint64_t>, WordCount>, 2> slots{};
+    };
+
+}
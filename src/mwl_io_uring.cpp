@@ -0,0 +1,128 @@
+#include "mwl_io_uring.hpp"
+
+#include <cerrno>
+
+namespace mwl {
+
+    // Completions identify the fd by its index in the span passed to wait, and carry the events they were armed with
+    static constexpr auto pack_user_data(size_t index, short events) -> uint64_t
+    {
+        return (static_cast<uint64_t>(index) << 16) | static_cast<uint16_t>(events);
+    }
+
+    IoUringPoller::~IoUringPoller()
+    {
+        if (is_initialized)
+        {
+            io_uring_queue_exit(&ring);
+        }
+    }
+
+    auto IoUringPoller::init(uint32_t queue_depth) -> bool
+    {
+        is_initialized = io_uring_queue_init(queue_depth, &ring, 0) == 0;
+        return is_initialized;
+    }
+
+    auto IoUringPoller::wait(std::span<pollfd> fds, int32_t timeout_ms) -> int32_t
+    {
+        armed_events.resize(fds.size());
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            fds[i].revents = 0;
+
+            // One-shot polls check the current state of the fd when they're armed, which gives us the same
+            // level-triggered behavior as poll(). Multishot polls only fire on new wakeups and would miss data
+            // that libwayland left unread in the socket.
+            const auto missing_events = static_cast<short>(fds[i].events & ~armed_events[i]);
+
+            if (missing_events == 0)
+            {
+                continue;
+            }
+
+            auto* sqe = io_uring_get_sqe(&ring);
+
+            if (!sqe)
+            {
+                // The submission queue is full, submit what we have and try again
+                const auto submitted = io_uring_submit(&ring);
+                ++syscalls;
+                sqe = io_uring_get_sqe(&ring);
+
+                // Reported like a failed poll(). The polls armed so far stay in the ring and complete as usual.
+                if (!sqe)
+                {
+                    errno = submitted < 0 ? -submitted : EBUSY;
+                    return -1;
+                }
+            }
+
+            io_uring_prep_poll_add(sqe, fds[i].fd, static_cast<uint16_t>(missing_events));
+            io_uring_sqe_set_data64(sqe, pack_user_data(i, missing_events));
+            armed_events[i] |= missing_events;
+        }
+
+        io_uring_cqe* cqe = nullptr;
+        auto result = io_uring_peek_cqe(&ring, &cqe);
+
+        if (result == -EAGAIN && timeout_ms != 0)
+        {
+            auto timeout = __kernel_timespec { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1'000'000ll };
+            result = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, timeout_ms < 0 ? nullptr : &timeout, nullptr);
+            ++syscalls;
+        }
+        else if (io_uring_sq_ready(&ring) > 0)
+        {
+            io_uring_submit(&ring);
+            ++syscalls;
+
+            // Polls on fds that are already ready complete during the submit, pick those up as well
+            // rather than reporting them one call late
+            if (result == -EAGAIN)
+            {
+                result = io_uring_peek_cqe(&ring, &cqe);
+            }
+        }
+
+        if (result == -EAGAIN || result == -ETIME)
+        {
+            return 0;
+        }
+
+        if (result < 0)
+        {
+            errno = -result;
+            return -1;
+        }
+
+        auto head = 0u;
+        auto completed = 0u;
+
+        io_uring_for_each_cqe(&ring, head, cqe)
+        {
+            const auto user_data = io_uring_cqe_get_data64(cqe);
+            const auto index = static_cast<size_t>(user_data >> 16);
+            const auto events = static_cast<short>(user_data & 0xFFFF);
+
+            armed_events[index] &= ~events;
+
+            // Errors are reported on the fd the same way poll() does it
+            fds[index].revents |= cqe->res < 0 ? POLLERR : static_cast<short>(cqe->res);
+            ++completed;
+        }
+
+        io_uring_cq_advance(&ring, completed);
+
+        auto ready = 0;
+
+        for (const auto& fd : fds)
+        {
+            ready += fd.revents != 0;
+        }
+
+        return ready;
+    }
+
+}
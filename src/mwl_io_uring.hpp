@@ -0,0 +1,36 @@
+#pragma once
+
+#include <liburing.h>
+#include <poll.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace mwl {
+
+    // Waits on a set of fds through an io_uring instead of poll(). Polls stay armed in the ring until
+    // they complete, so waiting on fds that haven't changed only costs the io_uring_enter that waits,
+    // and completions that were already posted are picked up without entering the kernel at all.
+    struct IoUringPoller
+    {
+        ~IoUringPoller();
+
+        auto init(uint32_t queue_depth) -> bool;
+
+        // Same contract as poll(), the fds have to be passed in the same order every time
+        auto wait(std::span<pollfd> fds, int32_t timeout_ms) -> int32_t;
+
+        // Number of io_uring_enter calls made by wait, for comparing against poll()
+        [[nodiscard]] auto syscall_count() const noexcept -> uint64_t { return syscalls; }
+
+    private:
+        io_uring ring{};
+        bool is_initialized = false;
+
+        // Poll events that are currently armed in the ring for each fd
+        std::vector<short> armed_events;
+        uint64_t syscalls = 0;
+    };
+
+}
@@ -2,13 +2,23 @@
 
 #include "mwl/mwl_input.hpp"
 
-#include <map>
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <linux/input-event-codes.h>
 
 namespace mwl {
 
-    inline static const auto key_table = std::map<uint32_t, uint32_t> {
+    // Returned for codes that have no translation
+    inline constexpr uint32_t InvalidInputCode = ~0u;
+
+    struct InputCodeMapping
+    {
+        uint32_t from;
+        uint32_t to;
+    };
+
+    inline constexpr auto key_mappings = std::to_array<InputCodeMapping>({
 
         { KEY_SPACE, MWL_KEY_SPACE },
         { KEY_APOSTROPHE, MWL_KEY_APOSTROPHE },
@@ -129,9 +139,9 @@ namespace mwl {
         { KEY_RIGHTMETA, MWL_KEY_RIGHT_SUPER },
         { KEY_MENU, MWL_KEY_MENU },
 
-    };
+    });
 
-    inline static const auto button_table = std::map<uint32_t, uint32_t> {
+    inline constexpr auto button_mappings = std::to_array<InputCodeMapping>({
 
         { BTN_LEFT, MWL_BUTTON_LEFT },
         { BTN_RIGHT, MWL_BUTTON_RIGHT },
@@ -142,6 +152,72 @@ namespace mwl {
         { BTN_BACK, MWL_BUTTON_BACK },
         { BTN_TASK, MWL_BUTTON_TASK },
 
-    };
+    });
+
+    // Expands a list of mappings into a table indexed by `from - base`, with InvalidInputCode in the gaps
+    template<size_t Size, size_t Count>
+    consteval auto make_input_table(const std::array<InputCodeMapping, Count>& mappings, uint32_t base) -> std::array<uint32_t, Size>
+    {
+        auto table = std::array<uint32_t, Size>{};
+        table.fill(InvalidInputCode);
+
+        for (const auto& mapping : mappings)
+        {
+            table[mapping.from - base] = mapping.to;
+        }
+
+        return table;
+    }
+
+    template<size_t Count>
+    consteval auto invert_input_mappings(const std::array<InputCodeMapping, Count>& mappings) -> std::array<InputCodeMapping, Count>
+    {
+        auto inverted = mappings;
+
+        for (auto& mapping : inverted)
+        {
+            std::swap(mapping.from, mapping.to);
+        }
+
+        return inverted;
+    }
+
+    template<size_t Count>
+    consteval auto input_table_size(const std::array<InputCodeMapping, Count>& mappings, uint32_t base) -> size_t
+    {
+        return std::ranges::max(mappings, {}, &InputCodeMapping::from).from - base + 1;
+    }
+
+    inline constexpr auto mwl_key_mappings = invert_input_mappings(key_mappings);
+
+    // Evdev KEY_* -> MWL_KEY_*
+    inline constexpr auto key_table = make_input_table<input_table_size(key_mappings, 0)>(key_mappings, 0);
+
+    // MWL_KEY_* -> evdev KEY_*
+    inline constexpr auto reverse_key_table = make_input_table<input_table_size(mwl_key_mappings, 0)>(mwl_key_mappings, 0);
+
+    // Evdev BTN_* -> MWL_BUTTON_*, mouse buttons start at BTN_MOUSE
+    inline constexpr auto button_table = make_input_table<input_table_size(button_mappings, BTN_MOUSE)>(button_mappings, BTN_MOUSE);
+
+    // Out of range codes map to InvalidInputCode, so these are a compare and a load
+    [[nodiscard]] constexpr auto translate_key(uint32_t key) -> uint32_t
+    {
+        return key < key_table.size() ? key_table[key] : InvalidInputCode;
+    }
+
+    [[nodiscard]] constexpr auto translate_mwl_key(uint32_t key) -> uint32_t
+    {
+        return key < reverse_key_table.size() ? reverse_key_table[key] : InvalidInputCode;
+    }
+
+    [[nodiscard]] constexpr auto translate_button(uint32_t button) -> uint32_t
+    {
+        // Unsigned wrap around sends codes below BTN_MOUSE out of range as well
+        const auto index = button - BTN_MOUSE;
+        return index < button_table.size() ? button_table[index] : InvalidInputCode;
+    }
+
+    static_assert(translate_key(KEY_A) == MWL_KEY_A && translate_mwl_key(MWL_KEY_A) == KEY_A);
+    static_assert(translate_button(BTN_LEFT) == MWL_BUTTON_LEFT && translate_button(BTN_LEFT - 1) == InvalidInputCode);
 
 }
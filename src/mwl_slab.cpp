@@ -0,0 +1,76 @@
+#include "mwl_slab.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace mwl {
+
+    // Every slot is laid out as [padding][SlotHeader][object], so the header can be found from the object alone
+    static constexpr auto round_up(size_t value, size_t alignment) -> size_t
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    Slab::~Slab()
+    {
+        for (auto* chunk : chunks)
+        {
+            ::operator delete(chunk, std::align_val_t(alignment));
+        }
+    }
+
+    void Slab::init(size_t object_size, size_t object_alignment, uint32_t chunk_slots)
+    {
+        alignment = std::max(object_alignment, alignof(SlotHeader));
+        slot_size = round_up(sizeof(SlotHeader), alignment) + round_up(object_size, alignment);
+        slots_per_chunk = chunk_slots;
+    }
+
+    auto Slab::allocate() -> void*
+    {
+        if (!free_list)
+        {
+            grow();
+        }
+
+        auto* header = free_list;
+        free_list = header->next_free;
+        header->next_free = nullptr;
+
+        return header + 1;
+    }
+
+    void Slab::deallocate(void* object)
+    {
+        auto* header = header_of(object);
+        ++header->generation;
+        header->next_free = free_list;
+        free_list = header;
+    }
+
+    auto Slab::generation(const void* object) -> uint32_t
+    {
+        return header_of(object)->generation;
+    }
+
+    auto Slab::header_of(const void* object) -> SlotHeader*
+    {
+        return const_cast<SlotHeader*>(static_cast<const SlotHeader*>(object) - 1);
+    }
+
+    void Slab::grow()
+    {
+        auto* chunk = static_cast<std::byte*>(::operator new(slot_size * slots_per_chunk, std::align_val_t(alignment)));
+        chunks.push_back(chunk);
+
+        const auto header_offset = round_up(sizeof(SlotHeader), alignment) - sizeof(SlotHeader);
+
+        // Pushed in reverse so slots are handed out in address order
+        for (uint32_t i = slots_per_chunk; i-- > 0;)
+        {
+            auto* header = new (chunk + i * slot_size + header_offset) SlotHeader { 1, free_list };
+            free_list = header;
+        }
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mwl {
+
+    // Fixed size slots carved out of larger chunks, so creating and destroying objects doesn't hit the heap
+    // once the slab has grown large enough. Chunks are only freed when the slab itself is destroyed, which
+    // keeps slot addresses stable and lets the generation of a slot be read after its object is gone.
+    // Not thread safe.
+    struct Slab
+    {
+        Slab() = default;
+        Slab(const Slab&) = delete;
+        auto operator=(const Slab&) -> Slab& = delete;
+        ~Slab();
+
+        void init(size_t object_size, size_t object_alignment, uint32_t slots_per_chunk = 32);
+
+        // Returns uninitialized storage for an object, reusing the most recently freed slot first
+        [[nodiscard]] auto allocate() -> void*;
+
+        // The object has to be destroyed already. Bumps the generation of the slot.
+        void deallocate(void* object);
+
+        // Changes every time the slot of `object` is deallocated, handles compare it to detect reuse
+        [[nodiscard]] static auto generation(const void* object) -> uint32_t;
+
+    private:
+        struct SlotHeader
+        {
+            uint32_t generation;
+            SlotHeader* next_free;
+        };
+
+        [[nodiscard]] static auto header_of(const void* object) -> SlotHeader*;
+        void grow();
+
+        size_t alignment = 0;
+        size_t slot_size = 0;
+        uint32_t slots_per_chunk = 0;
+
+        SlotHeader* free_list = nullptr;
+        std::vector<std::byte*> chunks;
+    };
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+
+namespace mwl {
+
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread.
+    // Each side keeps a cached copy of the other side's index so it only touches the shared
+    // cache line when the queue looks full (producer) or empty (consumer).
+    template<typename T, size_t Capacity>
+    struct SpscQueue
+    {
+        static_assert(std::has_single_bit(Capacity), "Capacity has to be a power of two");
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        // Producer only
+        [[nodiscard]] auto try_push(const T& value) -> bool
+        {
+            const auto tail = producer.tail.load(std::memory_order_relaxed);
+
+            if (tail - producer.cached_head == Capacity)
+            {
+                producer.cached_head = consumer.head.load(std::memory_order_acquire);
+
+                if (tail - producer.cached_head == Capacity)
+                {
+                    return false;
+                }
+            }
+
+            slots[tail & (Capacity - 1)] = value;
+            producer.tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Producer only. Either pushes all of `values` or none of them, the consumer never sees a partial batch.
+        [[nodiscard]] auto try_push(std::span<const T> values) -> bool
+        {
+            const auto tail = producer.tail.load(std::memory_order_relaxed);
+
+            if (Capacity - (tail - producer.cached_head) < values.size())
+            {
+                producer.cached_head = consumer.head.load(std::memory_order_acquire);
+
+                if (Capacity - (tail - producer.cached_head) < values.size())
+                {
+                    return false;
+                }
+            }
+
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                slots[(tail + i) & (Capacity - 1)] = values[i];
+            }
+
+            producer.tail.store(tail + values.size(), std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only
+        [[nodiscard]] auto try_pop(T& value) -> bool
+        {
+            const auto head = consumer.head.load(std::memory_order_relaxed);
+
+            if (head == consumer.cached_tail)
+            {
+                consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+
+                if (head == consumer.cached_tail)
+                {
+                    return false;
+                }
+            }
+
+            value = slots[head & (Capacity - 1)];
+            consumer.head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        struct alignas(64)
+        {
+            std::atomic<size_t> tail = 0;
+            size_t cached_head = 0;
+        } producer;
+
+        struct alignas(64)
+        {
+            std::atomic<size_t> head = 0;
+            size_t cached_tail = 0;
+        } consumer;
+
+        alignas(64) std::array<T, Capacity> slots{};
+    };
+
+}
@@ -0,0 +1,171 @@
+#include "mwl_thread_pool.hpp"
+
+namespace mwl {
+
+    static constexpr auto pack_range(uint32_t begin, uint32_t end) -> uint64_t
+    {
+        return (static_cast<uint64_t>(end) << 32) | begin;
+    }
+
+    static constexpr auto range_begin(uint64_t range) -> uint32_t
+    {
+        return static_cast<uint32_t>(range);
+    }
+
+    static constexpr auto range_end(uint64_t range) -> uint32_t
+    {
+        return static_cast<uint32_t>(range >> 32);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        is_stopping = true;
+        generation.fetch_add(1);
+        generation.notify_all();
+
+        // jthread joins on destruction
+        workers.clear();
+    }
+
+    void ThreadPool::init(uint32_t worker_count)
+    {
+        // One range per worker, plus one for whichever thread calls parallel_for
+        ranges = std::make_unique<WorkRange[]>(worker_count + 1);
+
+        workers.reserve(worker_count);
+
+        for (uint32_t i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back([this, i] { worker_main(i); });
+        }
+    }
+
+    auto ThreadPool::participant_count() const noexcept -> uint32_t
+    {
+        return static_cast<uint32_t>(workers.size()) + 1;
+    }
+
+    void ThreadPool::parallel_for(uint32_t count, TaskFn task_fn, void* data)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        auto lock = std::scoped_lock{ submit_mutex };
+
+        const auto participants = participant_count();
+        const auto caller = participants - 1;
+
+        task = task_fn;
+        task_data = data;
+
+        for (uint32_t i = 0; i < participants; ++i)
+        {
+            const auto begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * i / participants);
+            const auto end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / participants);
+            ranges[i].packed.store(pack_range(begin, end), std::memory_order_release);
+        }
+
+        if (participants > 1)
+        {
+            busy_workers.store(caller, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+            generation.notify_all();
+        }
+
+        run_until_empty(caller);
+
+        // Workers may still be finishing the indices they claimed, and every one of them has to be done
+        // with this job's ranges (including a steal in flight) before they're reused for the next one
+        for (auto busy = busy_workers.load(std::memory_order_acquire); busy != 0; busy = busy_workers.load(std::memory_order_acquire))
+        {
+            busy_workers.wait(busy, std::memory_order_acquire);
+        }
+    }
+
+    void ThreadPool::worker_main(uint32_t participant)
+    {
+        // Not loaded from generation, a job may have been submitted before this thread got to run
+        auto seen_generation = uint32_t{};
+
+        while (true)
+        {
+            generation.wait(seen_generation, std::memory_order_acquire);
+            seen_generation = generation.load(std::memory_order_acquire);
+
+            if (is_stopping)
+            {
+                return;
+            }
+
+            run_until_empty(participant);
+
+            if (busy_workers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                busy_workers.notify_all();
+            }
+        }
+    }
+
+    void ThreadPool::run_until_empty(uint32_t participant)
+    {
+        do
+        {
+            uint32_t index;
+
+            while (pop(participant, index))
+            {
+                // parallel_for waits for every worker before it returns, so the task can't be stale
+                task(task_data, index);
+            }
+        } while (steal(participant));
+    }
+
+    auto ThreadPool::pop(uint32_t participant, uint32_t& index) -> bool
+    {
+        auto& range = ranges[participant].packed;
+        auto current = range.load(std::memory_order_acquire);
+
+        while (range_begin(current) < range_end(current))
+        {
+            if (range.compare_exchange_weak(current, pack_range(range_begin(current) + 1, range_end(current)), std::memory_order_acq_rel))
+            {
+                index = range_begin(current);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    auto ThreadPool::steal(uint32_t thief) -> bool
+    {
+        const auto participants = participant_count();
+
+        for (uint32_t offset = 1; offset < participants; ++offset)
+        {
+            auto& victim = ranges[(thief + offset) % participants].packed;
+            auto current = victim.load(std::memory_order_acquire);
+
+            while (range_begin(current) < range_end(current))
+            {
+                const auto begin = range_begin(current);
+                const auto end = range_end(current);
+
+                // Take the back half, rounding up so a single remaining index can be stolen as well
+                const auto split = begin + (end - begin) / 2;
+
+                if (victim.compare_exchange_weak(current, pack_range(begin, split), std::memory_order_acq_rel))
+                {
+                    // Our own range is empty at this point, publish the stolen indices so they can be stolen in turn
+                    ranges[thief].packed.store(pack_range(split, end), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+}
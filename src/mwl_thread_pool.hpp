@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mwl {
+
+    // Small work-stealing pool for data parallel work (e.g rendering tiles of a ScreenBuffer).
+    // Every participant, including the thread calling parallel_for, starts out with an even share
+    // of the indices and steals half of another participant's remaining range once it runs dry.
+    struct ThreadPool
+    {
+        using TaskFn = void(*)(void* data, uint32_t index);
+
+        ~ThreadPool();
+
+        void init(uint32_t worker_count);
+
+        [[nodiscard]] auto participant_count() const noexcept -> uint32_t;
+
+        // Invokes task(data, i) for every i in [0, count) and blocks until all of them have finished.
+        void parallel_for(uint32_t count, TaskFn task, void* data);
+
+    private:
+        // Remaining indices of a participant packed as (end << 32) | begin, so both the owner popping
+        // from the front and thieves splitting off the back only need a single CAS.
+        struct alignas(64) WorkRange
+        {
+            std::atomic<uint64_t> packed;
+        };
+
+        std::vector<std::jthread> workers;
+        std::unique_ptr<WorkRange[]> ranges;
+
+        std::mutex submit_mutex;
+
+        TaskFn task = nullptr;
+        void* task_data = nullptr;
+
+        alignas(64) std::atomic<uint32_t> generation = 0;
+
+        // Workers that haven't gone back to waiting for the next job yet. parallel_for only returns once
+        // this reaches zero, so no worker can still be claiming indices when the next job publishes its ranges.
+        alignas(64) std::atomic<uint32_t> busy_workers = 0;
+        std::atomic<bool> is_stopping = false;
+
+        void worker_main(uint32_t participant);
+        void run_until_empty(uint32_t participant);
+
+        auto pop(uint32_t participant, uint32_t& index) -> bool;
+        auto steal(uint32_t thief) -> bool;
+    };
+
+}
@@ -2,14 +2,19 @@
 #include "mwl_linux_input_tables.hpp"
 
 #include <cerrno>
+#include <cmath>
 #include <ctime>
 #include <string>
 #include <atomic>
 #include <fcntl.h>
+#include <poll.h>
+#include <chrono>
 #include <cstring>
 #include <unistd.h>
 #include <algorithm>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <string_view>
 
 namespace mwl {
@@ -75,18 +80,231 @@ namespace mwl {
     static std::atomic_uint64_t buffers_created = 0;
     static std::atomic_uint64_t buffers_destroyed = 0;
 
-    static void buffer_release(void* data, wl_buffer* buffer)
+    static void buffer_release(void* data, wl_buffer*)
     {
-        // Sent by the compositor when it's no longer using this buffer
-        wl_buffer_destroy(buffer);
-        ++buffers_destroyed;
-
-        const auto* impl = static_cast<WaylandScreenBufferImpl*>(data);
-        munmap(impl->pixel_buffer, impl->pixel_buffer_size);
-        delete impl;
+        // Sent by the compositor when it's no longer using this buffer,
+        // at which point we're free to hand it out again.
+        static_cast<WaylandScreenBufferImpl*>(data)->is_busy = false;
     }
     static constexpr wl_buffer_listener buffer_listener = { buffer_release };
 
+    static auto to_wl_shm_format(PixelFormat format) -> wl_shm_format
+    {
+        switch (format)
+        {
+            case PixelFormat::XRGB8888: return WL_SHM_FORMAT_XRGB8888;
+            case PixelFormat::ARGB8888: return WL_SHM_FORMAT_ARGB8888;
+            case PixelFormat::RGB565: return WL_SHM_FORMAT_RGB565;
+            case PixelFormat::XRGB2101010: return WL_SHM_FORMAT_XRGB2101010;
+            case PixelFormat::ARGB2101010: return WL_SHM_FORMAT_ARGB2101010;
+        }
+
+        MWL_VERIFY(false, "Unknown pixel format");
+        return WL_SHM_FORMAT_XRGB8888;
+    }
+
+    static constexpr auto pixel_format_bit(PixelFormat format) -> uint32_t
+    {
+        return 1u << std::to_underlying(format);
+    }
+
+    static void shm_format(void* data, wl_shm*, uint32_t format)
+    {
+        auto* impl = static_cast<WaylandStateImpl*>(data);
+
+        for (auto pixel_format : { PixelFormat::XRGB8888, PixelFormat::ARGB8888, PixelFormat::RGB565, PixelFormat::XRGB2101010, PixelFormat::ARGB2101010 })
+        {
+            if (to_wl_shm_format(pixel_format) == format)
+            {
+                impl->supported_pixel_formats |= pixel_format_bit(pixel_format);
+            }
+        }
+    }
+
+    static constexpr auto shm_listener = wl_shm_listener { shm_format };
+
+    auto WaylandBufferPool::init(wl_shm* shm, int32_t width, int32_t height, PixelFormat pixel_format) -> bool
+    {
+        const auto pixel_size = bytes_per_pixel(pixel_format);
+        const auto stride = (width * pixel_size + RowAlignment - 1) / RowAlignment * RowAlignment;
+        const auto buffer_size = static_cast<size_t>(stride) * height;
+        const auto pool_size = buffer_size * BufferCount;
+        const auto fd = allocate_shm_file(pool_size);
+
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        auto* pool_memory = static_cast<uint8_t*>(mmap(nullptr, pool_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+
+        if (pool_memory == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        pool = wl_shm_create_pool(shm, fd, static_cast<int32_t>(pool_size));
+        memory = pool_memory;
+        memory_size = pool_size;
+
+        // The compositor keeps its own mapping of the pool, so we don't need the fd past this point.
+        close(fd);
+
+        for (size_t i = 0; i < BufferCount; ++i)
+        {
+            auto& buffer_impl = buffers[i];
+            buffer_impl.pixel_buffer = memory + i * buffer_size;
+            buffer_impl.pixel_buffer_size = buffer_size;
+            buffer_impl.width = width;
+            buffer_impl.height = height;
+            buffer_impl.stride = stride;
+            buffer_impl.pixel_format = pixel_format;
+            buffer_impl.is_busy = false;
+            buffer_impl.buffer = wl_shm_pool_create_buffer(
+                pool,
+                static_cast<int32_t>(i * buffer_size),
+                width, height,
+                stride,
+                to_wl_shm_format(pixel_format));
+            ++buffers_created;
+
+            wl_buffer_add_listener(buffer_impl.buffer, &buffer_listener, &buffer_impl);
+        }
+
+        this->width = width;
+        this->height = height;
+        this->pixel_format = pixel_format;
+
+        return true;
+    }
+
+    void WaylandBufferPool::destroy()
+    {
+        // Destroying a wl_buffer that the compositor still holds is fine as long as we never
+        // touch the underlying storage again, which we won't since it's unmapped below.
+        for (auto& buffer_impl : buffers)
+        {
+            if (buffer_impl.buffer)
+            {
+                wl_buffer_destroy(buffer_impl.buffer);
+                ++buffers_destroyed;
+            }
+
+            buffer_impl = {};
+        }
+
+        if (pool)
+        {
+            wl_shm_pool_destroy(pool);
+            pool = nullptr;
+        }
+
+        if (memory)
+        {
+            munmap(memory, memory_size);
+            memory = nullptr;
+            memory_size = 0;
+        }
+
+        width = 0;
+        height = 0;
+
+        frame_count = 0;
+        last_presented = nullptr;
+        fetched = nullptr;
+
+        for (auto& damage : damage_history)
+        {
+            damage.clear();
+        }
+    }
+
+    auto WaylandBufferPool::acquire() -> WaylandScreenBufferImpl*
+    {
+        // The caller may have drawn into it before dropping it, so its contents are undefined
+        if (fetched)
+        {
+            fetched->age = 0;
+            fetched->damage.clear();
+            return fetched;
+        }
+
+        for (auto& buffer_impl : buffers)
+        {
+            if (!buffer_impl.is_busy)
+            {
+                buffer_impl.is_busy = true;
+                buffer_impl.age = buffer_impl.presented_frame == 0
+                    ? 0
+                    : static_cast<uint32_t>(frame_count - buffer_impl.presented_frame + 1);
+                fetched = &buffer_impl;
+                return &buffer_impl;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void WaylandBufferPool::mark_presented(WaylandScreenBufferImpl* buffer_impl)
+    {
+        ++frame_count;
+
+        auto& damage = damage_history[frame_count % DamageHistorySize];
+
+        if (buffer_impl->damage.empty())
+        {
+            damage.assign({ Rect { 0, 0, width, height } });
+        }
+        else
+        {
+            damage.assign(buffer_impl->damage.begin(), buffer_impl->damage.end());
+        }
+
+        buffer_impl->presented_frame = frame_count;
+        last_presented = buffer_impl;
+
+        if (buffer_impl == fetched)
+        {
+            fetched = nullptr;
+        }
+    }
+
+    void WaylandBufferPool::copy_forward(WaylandScreenBufferImpl* buffer_impl)
+    {
+        if (!last_presented || buffer_impl->age == 1)
+        {
+            return;
+        }
+
+        const auto* src = last_presented->pixel_buffer;
+        auto* dst = buffer_impl->pixel_buffer;
+
+        // Either the buffer has never been presented, or it's older than the history we keep around
+        if (buffer_impl->age == 0 || buffer_impl->age - 1 > DamageHistorySize)
+        {
+            std::memcpy(dst, src, buffer_impl->pixel_buffer_size);
+            buffer_impl->age = 1;
+            return;
+        }
+
+        for (auto frame = buffer_impl->presented_frame + 1; frame <= frame_count; ++frame)
+        {
+            for (const auto& rect : damage_history[frame % DamageHistorySize])
+            {
+                const auto pixel_size = static_cast<size_t>(bytes_per_pixel(pixel_format));
+
+                for (int32_t y = rect.y; y < rect.y + rect.height; ++y)
+                {
+                    const auto offset = static_cast<size_t>(y) * buffer_impl->stride + rect.x * pixel_size;
+                    std::memcpy(dst + offset, src + offset, rect.width * pixel_size);
+                }
+            }
+        }
+
+        buffer_impl->age = 1;
+    }
+
     static void xdg_wm_base_ping(void*, xdg_wm_base* wm_base, uint32_t serial)
     {
         xdg_wm_base_pong(wm_base, serial);
@@ -99,164 +317,247 @@ namespace mwl {
         return std::min(supported, requested);
     }
 
+    // Event times that are further away from the current time than this can't be CLOCK_MONOTONIC
+    static constexpr int64_t MaxMonotonicEventAge = 10'000'000'000;
+
+    auto WaylandInputClock::from_nanoseconds(uint64_t nanoseconds) -> EventTimestamp
+    {
+        const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        const auto time = static_cast<int64_t>(nanoseconds);
+
+        if (!is_synchronized)
+        {
+            offset = std::abs(now - time) < MaxMonotonicEventAge ? 0 : now - time;
+            is_synchronized = true;
+        }
+        else if (offset != 0 && time + offset > now)
+        {
+            // Events can't come from the future, so the offset was too large. Latency only ever makes the
+            // estimate too large, never too small, which means it converges on the smallest observed delay.
+            offset = now - time;
+        }
+
+        return EventTimestamp(time + offset);
+    }
+
+    auto WaylandInputClock::from_milliseconds(uint32_t milliseconds) -> EventTimestamp
+    {
+        // Signed distance to the previous timestamp, which stays correct across a wrap
+        const auto elapsed = static_cast<int32_t>(milliseconds - static_cast<uint32_t>(last_milliseconds));
+        last_milliseconds = last_milliseconds == 0 ? milliseconds : last_milliseconds + elapsed;
+
+        return from_nanoseconds(last_milliseconds * 1'000'000);
+    }
+
+    static auto to_nanoseconds(uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) -> uint64_t
+    {
+        const auto seconds = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+        return seconds * 1'000'000'000 + tv_nsec;
+    }
+
+    static void pointer_timestamp(void* data, zwp_input_timestamps_v1*, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec)
+    {
+        static_cast<WaylandStateImpl*>(data)->input.pending_pointer_time = to_nanoseconds(tv_sec_hi, tv_sec_lo, tv_nsec);
+    }
+
+    static void keyboard_timestamp(void* data, zwp_input_timestamps_v1*, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec)
+    {
+        static_cast<WaylandStateImpl*>(data)->input.pending_keyboard_time = to_nanoseconds(tv_sec_hi, tv_sec_lo, tv_nsec);
+    }
+
+    static constexpr auto pointer_timestamps_listener = zwp_input_timestamps_v1_listener { pointer_timestamp };
+    static constexpr auto keyboard_timestamps_listener = zwp_input_timestamps_v1_listener { keyboard_timestamp };
+
+    // Prefers the precise timestamp that preceded the event, if there is one
+    static auto event_timestamp(WaylandStateImpl* impl, uint64_t& pending_time, uint32_t milliseconds) -> EventTimestamp
+    {
+        if (pending_time == 0)
+        {
+            return impl->input.clock.from_milliseconds(milliseconds);
+        }
+
+        return impl->input.clock.from_nanoseconds(std::exchange(pending_time, 0));
+    }
+
     void pointer_enter(void* data, wl_pointer*, uint32_t, wl_surface* surface, wl_fixed_t, wl_fixed_t)
     {
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        impl->input.focused_pointer_window = static_cast<WaylandWindowImpl*>(wl_surface_get_user_data(surface));
+        impl->input.focused_pointer_surface = surface;
     }
 
 	void pointer_leave(void* data, wl_pointer*, uint32_t, wl_surface*)
 	{
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        impl->input.focused_pointer_window = nullptr;
+        impl->input.focused_pointer_surface = nullptr;
 	}
 
-	void pointer_motion(void* data, wl_pointer*, uint32_t, wl_fixed_t pointer_x, wl_fixed_t pointer_y)
+    static void pointer_frame(void* data, wl_pointer*);
+
+    // wl_pointer.frame only exists since version 5, older compositors send every event on its own
+    static void end_pointer_event(void* data, wl_pointer* pointer)
+    {
+        if (wl_pointer_get_version(pointer) < WL_POINTER_FRAME_SINCE_VERSION)
+        {
+            pointer_frame(data, pointer);
+        }
+    }
+
+	void pointer_motion(void* data, wl_pointer* pointer, uint32_t time, wl_fixed_t pointer_x, wl_fixed_t pointer_y)
 	{
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseMotionEvent>();
-        event->x = wl_fixed_to_int(pointer_x);
-        event->y = wl_fixed_to_int(pointer_y);
+        auto& frame = impl->input.pointer_frame;
+        frame.timestamp = event_timestamp(impl, impl->input.pending_pointer_time, time);
+        frame.has_motion = true;
+        frame.x = wl_fixed_to_int(pointer_x);
+        frame.y = wl_fixed_to_int(pointer_y);
+        end_pointer_event(data, pointer);
 	}
 
-	void pointer_button(void* data, wl_pointer*, uint32_t, uint32_t, uint32_t button, uint32_t state)
+	void pointer_button(void* data, wl_pointer* pointer, uint32_t, uint32_t time, uint32_t button, uint32_t state)
 	{
-        MWL_VERIFY(button_table.contains(button), "Unknown button");
-        MWL_VERIFY(button_table.at(button) <= 31, "Cannot represent button codes above 31.");
+        const auto mwl_button = translate_button(button);
+        MWL_VERIFY(mwl_button != InvalidInputCode, "Unknown button");
+        MWL_VERIFY(mwl_button <= 31, "Cannot represent button codes above 31.");
 
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseButtonEvent>();
-        event->button = button_table.at(button);
-        event->state = state == WL_KEYBOARD_KEY_STATE_PRESSED ? ButtonState::Pressed : ButtonState::Released;
+        auto& frame = impl->input.pointer_frame;
+        frame.timestamp = event_timestamp(impl, impl->input.pending_pointer_time, time);
+
+        if (frame.button_count < WaylandPointerFrame::MaxButtons)
+        {
+            const auto button_state = state == WL_POINTER_BUTTON_STATE_PRESSED ? ButtonState::Pressed : ButtonState::Released;
+            frame.buttons[frame.button_count++] = MouseButtonEvent(mwl_button, button_state, frame.timestamp);
+        }
+
+        end_pointer_event(data, pointer);
 	}
 
-	void pointer_axis(void* data, wl_pointer*, uint32_t, uint32_t axis, wl_fixed_t)
+	void pointer_axis(void* data, wl_pointer* pointer, uint32_t time, uint32_t axis, wl_fixed_t value)
 	{
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
-        event->axis = axis == WL_POINTER_AXIS_VERTICAL_SCROLL ? ScrollAxis::Vertical : ScrollAxis::Horizontal;
+        auto& frame = impl->input.pointer_frame;
+        frame.timestamp = event_timestamp(impl, impl->input.pending_pointer_time, time);
+        frame.axes[axis].has_event = true;
+        frame.axes[axis].distance += wl_fixed_to_double(value);
+        end_pointer_event(data, pointer);
 	}
 
 	void pointer_axis_source(void* data, wl_pointer*, uint32_t axis_source)
 	{
-        auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
+        auto& frame = static_cast<WaylandStateImpl*>(data)->input.pointer_frame;
 
         if (axis_source == WL_POINTER_AXIS_SOURCE_WHEEL)
         {
-            event->source = ScrollSource::Wheel;
+            frame.source = ScrollSource::Wheel;
         }
         else if (axis_source == WL_POINTER_AXIS_SOURCE_FINGER)
         {
-            event->source = ScrollSource::Finger;
+            frame.source = ScrollSource::Finger;
         }
         else if (axis_source == WL_POINTER_AXIS_SOURCE_CONTINUOUS)
         {
-            event->source = ScrollSource::Continuous;
+            frame.source = ScrollSource::Continuous;
         }
         else if (axis_source == WL_POINTER_AXIS_SOURCE_WHEEL_TILT)
         {
-            event->source = ScrollSource::WheelTilt;
+            frame.source = ScrollSource::WheelTilt;
         }
 	}
 
-	void pointer_axis_relative_direction(void* data, wl_pointer*, uint32_t, uint32_t relative_direction)
+	void pointer_axis_relative_direction(void* data, wl_pointer*, uint32_t axis, uint32_t relative_direction)
 	{
-        auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
-        event->scalar = relative_direction == WL_POINTER_AXIS_RELATIVE_DIRECTION_INVERTED ? -1 : 1;
+        auto& frame = static_cast<WaylandStateImpl*>(data)->input.pointer_frame;
+        frame.axes[axis].scalar = relative_direction == WL_POINTER_AXIS_RELATIVE_DIRECTION_INVERTED ? -1 : 1;
 	}
 
-	void pointer_axis_value120(void* data, wl_pointer*, uint32_t, int32_t value120)
+	void pointer_axis_value120(void* data, wl_pointer*, uint32_t axis, int32_t value120)
 	{
-        auto* impl = static_cast<WaylandStateImpl*>(data);
-        auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
-        event->value = value120 / 15; // Normalize range [-8..8]
+        auto& frame = static_cast<WaylandStateImpl*>(data)->input.pointer_frame;
+        frame.axes[axis].value = static_cast<int8_t>(std::clamp(value120 / 15, -8, 8)); // Normalize range [-8..8]
 	}
 
-	void pointer_axis_stop(void*, wl_pointer*, uint32_t, uint32_t)
+	void pointer_axis_stop(void* data, wl_pointer*, uint32_t, uint32_t axis)
 	{
-        MWL_VERIFY(false, "Not implemented.");
+        // Marks the end of a kinetic scroll sequence, there's nothing to deliver for it.
+        // Whatever didn't add up to a step belongs to the old sequence.
+        static_cast<WaylandStateImpl*>(data)->input.scroll_accumulator.remainder[axis] = 0.0;
 	}
 
     // NOTE(Peter): Deprecated with wl_seat versions >=8, but we need to support it anyway in case
     //              the compositor doesn't support version 8 and above.
-	void pointer_axis_discrete(void* data, wl_pointer*, uint32_t, int32_t discrete)
+	void pointer_axis_discrete(void* data, wl_pointer*, uint32_t axis, int32_t discrete)
 	{
-        auto* impl = static_cast<WaylandStateImpl*>(data);
-
-        if (discrete == 0)
-        {
-            // NOTE(Peter): For some reason we recieve events with a "0" step.
-            //              Since that's the equivalent of no event we'll simply ignore this.
-            impl->input.skip_current = true;
-            return;
-        }
-
-        auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
-        event->value = discrete;
+        // One discrete step is 120 in value120 terms, so 8 after normalizing
+        auto& frame = static_cast<WaylandStateImpl*>(data)->input.pointer_frame;
+        frame.axes[axis].value = static_cast<int8_t>(std::clamp(discrete * 8, -8, 8));
 	}
 
     void pointer_frame(void* data, wl_pointer*)
     {
         auto* impl = static_cast<WaylandStateImpl*>(data);
+        auto& frame = impl->input.pointer_frame;
 
-        if (!impl->input.focused_pointer_window || !impl->input.current_event)
+        // Motion, every button and both scroll axes fit into a single batch
+        auto events = std::array<WaylandInputEvent, 1 + WaylandPointerFrame::MaxButtons + 2>{};
+        auto count = size_t{0};
+
+        auto add_event = [&](auto data)
         {
-            return;
-        }
+            events[count++] = { .surface = impl->input.focused_pointer_surface, .data = data };
+        };
 
-        if (impl->input.skip_current)
+        if (frame.has_motion)
         {
-            impl->input.current_event = nullptr;
-            impl->input.skip_current = false;
-            return;
+            add_event(MouseMotionEvent(frame.x, frame.y, 0, 0, frame.timestamp));
         }
 
-        auto call_if_set = []<typename... Args>(const auto& func, Args&&... args)
+        for (uint32_t i = 0; i < frame.button_count; ++i)
         {
-            if (!func)
-            {
-                return;
-            }
+            add_event(frame.buttons[i]);
+        }
 
-            func(std::forward<Args>(args)...);
-        };
+        auto& accumulator = impl->input.scroll_accumulator;
 
-        switch (impl->input.current_event->type)
+        if (accumulator.source != frame.source)
         {
-            case WaylandEventType::Button:
-            {
-                auto* event = impl->input.fetch_event<WaylandMouseButtonEvent>();
-                call_if_set(
-                    impl->input.focused_pointer_window->mouse_button_callback,
-                    MouseButtonEvent(event->button, event->state));
-                break;
-            }
-            case WaylandEventType::MouseMotion:
-            {
-                auto* event = impl->input.fetch_event<WaylandMouseMotionEvent>();
-                call_if_set(
-                    impl->input.focused_pointer_window->mouse_motion_callback,
-                    MouseMotionEvent(event->x, event->y));
-                break;
-            }
-            case WaylandEventType::Scroll:
+            accumulator = { .source = frame.source, .remainder = {} };
+        }
+
+        for (uint32_t axis = 0; axis < frame.axes.size(); ++axis)
+        {
+            const auto& axis_frame = frame.axes[axis];
+            auto value = axis_frame.value;
+
+            // Touchpads and other continuous sources don't send steps, so we convert their distance instead.
+            // Compositors scroll 10 units per wheel step, which makes that 8 in our normalized range.
+            if (value == 0 && axis_frame.has_event)
             {
-                auto* event = impl->input.fetch_event<WaylandMouseScrollEvent>();
-                call_if_set(
-                    impl->input.focused_pointer_window->mouse_scroll_callback,
-                    MouseScrollEvent(event->axis, event->source, event->value * event->scalar));
-                break;
+                auto& remainder = accumulator.remainder[axis];
+                remainder += axis_frame.distance * 0.8;
+
+                const auto whole = std::trunc(remainder);
+                remainder -= whole;
+                value = static_cast<int8_t>(std::clamp(whole, -8.0, 8.0));
             }
-            default:
+
+            // NOTE(Peter): For some reason we recieve events with a "0" step.
+            //              Since that's the equivalent of no event we'll simply ignore this.
+            if (!axis_frame.has_event || value == 0)
             {
-                MWL_VERIFY(false, "Unknown Wayland event type");
-                break;
+                continue;
             }
+
+            const auto scroll_axis = axis == WL_POINTER_AXIS_VERTICAL_SCROLL ? ScrollAxis::Vertical : ScrollAxis::Horizontal;
+            const auto scalar = axis_frame.scalar != 0 ? axis_frame.scalar : 1;
+            add_event(MouseScrollEvent(scroll_axis, frame.source, static_cast<int8_t>(value * scalar), frame.timestamp));
         }
 
-        impl->input.current_event = nullptr;
+        frame = {};
+
+        if (impl->input.focused_pointer_surface && count > 0)
+        {
+            impl->emit_input_events(std::span(events).first(count));
+        }
     }
 
     static constexpr auto pointer_listener = wl_pointer_listener {
@@ -293,28 +594,71 @@ namespace mwl {
 	void keyboard_enter(void* data, wl_keyboard*, uint32_t, wl_surface* surface, wl_array*)
 	{
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        impl->input.focused_keyboard_window = static_cast<WaylandWindowImpl*>(wl_surface_get_user_data(surface));
+        impl->input.focused_keyboard_surface = surface;
 	}
 
-	void keyboard_leave(void* data, wl_keyboard*, uint32_t, wl_surface*)
+    static void set_key_repeat_timer(WaylandStateImpl* impl, int32_t delay, int32_t interval)
+    {
+        auto spec = itimerspec {
+            .it_interval = { .tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1'000'000 },
+            .it_value = { .tv_sec = delay / 1000, .tv_nsec = (delay % 1000) * 1'000'000 },
+        };
+
+        // An all zero it_value disarms the timer, which would keep a zero delay from ever repeating
+        if (interval > 0 && delay <= 0)
+        {
+            spec.it_value = { .tv_sec = 0, .tv_nsec = 1 };
+        }
+
+        timerfd_settime(impl->input.key_repeat.fd, 0, &spec, nullptr);
+    }
+
+	void keyboard_leave(void* data, wl_keyboard*, uint32_t, wl_surface* surface)
 	{
         auto* impl = static_cast<WaylandStateImpl*>(data);
-        impl->input.focused_keyboard_window = nullptr;
+        impl->input.focused_keyboard_surface = nullptr;
+        set_key_repeat_timer(impl, 0, 0);
+
+        const auto event = WaylandInputEvent { .surface = surface, .data = WaylandKeyboardLeaveEvent{} };
+        impl->emit_input_events({ &event, 1 });
 	}
 
-	void keyboard_key(void* data, wl_keyboard*, uint32_t, uint32_t, uint32_t key, uint32_t state)
+	void keyboard_key(void* data, wl_keyboard*, uint32_t, uint32_t time, uint32_t key, uint32_t state)
 	{
-        MWL_VERIFY(key_table.contains(key), "Unknown key");
+        const auto mwl_key = translate_key(key);
+        MWL_VERIFY(mwl_key != InvalidInputCode, "Unknown key");
 
         auto* impl = static_cast<WaylandStateImpl*>(data);
+        auto& key_repeat = impl->input.key_repeat;
+
+        if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
+        {
+            // Evdev keycodes are offset by 8 in XKB
+            if (key_repeat.rate > 0 && impl->input.keymap && xkb_keymap_key_repeats(impl->input.keymap, key + 8))
+            {
+                key_repeat.key = mwl_key;
+                set_key_repeat_timer(impl, key_repeat.delay, 1000 / key_repeat.rate);
+            }
+        }
+        else if (mwl_key == key_repeat.key)
+        {
+            set_key_repeat_timer(impl, 0, 0);
+        }
 
-        if (!impl->input.focused_keyboard_window || !impl->input.focused_keyboard_window->key_callback)
+        if (!impl->input.focused_keyboard_surface)
         {
             return;
         }
 
         auto key_state = state == WL_KEYBOARD_KEY_STATE_PRESSED ? ButtonState::Pressed : ButtonState::Released;
-        impl->input.focused_keyboard_window->key_callback(KeyEvent(key_table.at(key), key_state));
+
+        const auto timestamp = event_timestamp(impl, impl->input.pending_keyboard_time, time);
+        const auto event = WaylandInputEvent {
+            .surface = impl->input.focused_keyboard_surface,
+            .data = KeyEvent(mwl_key, key_state, false, timestamp),
+        };
+
+        impl->emit_input_events({ &event, 1 });
 	}
 
 	void keyboard_modifiers(void* data, wl_keyboard*, uint32_t, uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group)
@@ -323,9 +667,18 @@ namespace mwl {
         xkb_state_update_mask(impl->input.state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
 	}
 
-	void keyboard_repeat_info(void*, wl_keyboard*, int32_t, int32_t)
+	void keyboard_repeat_info(void* data, wl_keyboard*, int32_t rate, int32_t delay)
 	{
-        // TODO
+        auto* impl = static_cast<WaylandStateImpl*>(data);
+
+        // A rate of 0 disables key repeat
+        impl->input.key_repeat.rate = std::min(rate, 1000);
+        impl->input.key_repeat.delay = delay;
+
+        if (rate <= 0)
+        {
+            set_key_repeat_timer(impl, 0, 0);
+        }
 	}
 
     static constexpr auto keyboard_listener = wl_keyboard_listener {
@@ -337,30 +690,65 @@ namespace mwl {
         .repeat_info = keyboard_repeat_info,
     };
 
+    static void release_pointer(WaylandStateImpl* impl)
+    {
+        if (impl->input.pointer_timestamps)
+        {
+            zwp_input_timestamps_v1_destroy(impl->input.pointer_timestamps);
+            impl->input.pointer_timestamps = nullptr;
+        }
+
+        wl_pointer_release(impl->input.pointer);
+        impl->input.pointer = nullptr;
+    }
+
+    static void release_keyboard(WaylandStateImpl* impl)
+    {
+        if (impl->input.keyboard_timestamps)
+        {
+            zwp_input_timestamps_v1_destroy(impl->input.keyboard_timestamps);
+            impl->input.keyboard_timestamps = nullptr;
+        }
+
+        wl_keyboard_release(impl->input.keyboard);
+        impl->input.keyboard = nullptr;
+    }
+
     static void seat_capabilities(void* data, wl_seat* seat, uint32_t capabilities)
     {
         auto* impl = static_cast<WaylandStateImpl*>(data);
 
-        if (capabilities & WL_SEAT_CAPABILITY_POINTER)
+        // Capabilities are sent again whenever they change, only create the devices that are new
+        if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && !impl->input.pointer)
         {
             impl->input.pointer = wl_seat_get_pointer(seat);
             wl_pointer_add_listener(impl->input.pointer, &pointer_listener, data);
+
+            if (impl->timestamps_manager)
+            {
+                impl->input.pointer_timestamps = zwp_input_timestamps_manager_v1_get_pointer_timestamps(impl->timestamps_manager, impl->input.pointer);
+                zwp_input_timestamps_v1_add_listener(impl->input.pointer_timestamps, &pointer_timestamps_listener, data);
+            }
         }
-        else if (impl->input.pointer)
+        else if (!(capabilities & WL_SEAT_CAPABILITY_POINTER) && impl->input.pointer)
         {
-            wl_pointer_release(impl->input.pointer);
-            impl->input.pointer = nullptr;
+            release_pointer(impl);
         }
 
-        if (capabilities & WL_SEAT_CAPABILITY_KEYBOARD)
+        if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && !impl->input.keyboard)
         {
             impl->input.keyboard = wl_seat_get_keyboard(seat);
             wl_keyboard_add_listener(impl->input.keyboard, &keyboard_listener, data);
+
+            if (impl->timestamps_manager)
+            {
+                impl->input.keyboard_timestamps = zwp_input_timestamps_manager_v1_get_keyboard_timestamps(impl->timestamps_manager, impl->input.keyboard);
+                zwp_input_timestamps_v1_add_listener(impl->input.keyboard_timestamps, &keyboard_timestamps_listener, data);
+            }
         }
-        else if (impl->input.keyboard)
+        else if (!(capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && impl->input.keyboard)
         {
-            wl_keyboard_release(impl->input.keyboard);
-            impl->input.keyboard = nullptr;
+            release_keyboard(impl);
         }
 
         if (capabilities & WL_SEAT_CAPABILITY_TOUCH)
@@ -369,9 +757,8 @@ namespace mwl {
         }
     }
 
-    static void seat_name(void*, wl_seat*, const char *name)
+    static void seat_name(void*, wl_seat*, const char*)
     {
-        std::println("Seat name = {}", name);
     }
 
     static constexpr auto seat_listener = wl_seat_listener {
@@ -391,13 +778,7 @@ namespace mwl {
 
 	static void output_done(void* data, wl_output*)
 	{
-        auto output = static_cast<WaylandOutput*>(data);
-
-        std::println("----- OUTPUT -----");
-        std::println("Name: {}", output->name);
-        std::println("Description: {}", output->description);
-        std::println("Make: {}", output->make);
-        std::println("Model: {}", output->model);
+        static_cast<WaylandOutput*>(data)->is_done = true;
 	}
 
 	static void output_scale(void*, wl_output*, int32_t)
@@ -464,12 +845,16 @@ namespace mwl {
                 )),
                 name
             };
+
+            wl_shm_add_listener(impl->shm, &shm_listener, data);
         }
         else if (iview == wl_seat_interface.name)
         {
+            // With threaded input the seat is bound through a wrapper on the input queue,
+            // so the seat and every device created from it are dispatched by the input thread.
             impl->input.seat = {
                 static_cast<wl_seat*>(wl_registry_bind(
-                    reg,
+                    impl->input.registry_wrapper ? impl->input.registry_wrapper : reg,
                     name,
                     &wl_seat_interface,
                     min_version(supported_version, 9)
@@ -482,49 +867,62 @@ namespace mwl {
         else if (iview == zxdg_decoration_manager_v1_interface.name)
         {
             impl->decoration_manager = {
-                static_cast<zxdg_decoration_manager_v1*>(wl_registry_bind(
-                    reg,
-                    name,
-                    &zxdg_decoration_manager_v1_interface,
-                    min_version(supported_version, 1)
-                )),
-                name
+                .interface = &zxdg_decoration_manager_v1_interface,
+                .name = name,
+                .version = min_version(supported_version, 1),
+                .ptr = nullptr,
             };
         }
         else if (iview == wl_output_interface.name)
         {
-            auto output = std::make_unique<WaylandOutput>(WaylandOutput {
+            impl->outputs.emplace_back(std::make_unique<WaylandOutput>(WaylandOutput {
                 .global = {
-                    static_cast<wl_output*>(wl_registry_bind(
-                        reg,
-                        name,
-                        &wl_output_interface,
-                        min_version(supported_version, 4)
-                    )),
-                    name
+                    .interface = &wl_output_interface,
+                    .name = name,
+                    .version = min_version(supported_version, 4),
+                    .ptr = nullptr,
                 },
+                .is_done = false,
                 .name = "",
                 .description = "",
                 .make = "",
                 .model = ""
-            });
-
-            wl_output_add_listener(output->global, &output_listener, output.get());
-
-            impl->outputs.emplace_back(std::move(output));
+            }));
         }
-        else if (iview == wp_fractional_scale_manager_v1_interface.name)
+        else if (iview == zwp_input_timestamps_manager_v1_interface.name)
         {
-            impl->fractional_scale_manager = {
-                static_cast<wp_fractional_scale_manager_v1*>(wl_registry_bind(
+            // Timestamps have to arrive on the same queue as the input events they belong to
+            impl->timestamps_manager = {
+                static_cast<zwp_input_timestamps_manager_v1*>(wl_registry_bind(
+                    impl->input.registry_wrapper ? impl->input.registry_wrapper : reg,
+                    name,
+                    &zwp_input_timestamps_manager_v1_interface,
+                    min_version(supported_version, 1)
+                )),
+                name
+            };
+        }
+        else if (iview == wp_viewporter_interface.name)
+        {
+            impl->viewporter = {
+                static_cast<wp_viewporter*>(wl_registry_bind(
                     reg,
                     name,
-                    &wp_fractional_scale_manager_v1_interface,
+                    &wp_viewporter_interface,
                     min_version(supported_version, 1)
                 )),
                 name
             };
         }
+        else if (iview == wp_fractional_scale_manager_v1_interface.name)
+        {
+            impl->fractional_scale_manager = {
+                .interface = &wp_fractional_scale_manager_v1_interface,
+                .name = name,
+                .version = min_version(supported_version, 1),
+                .ptr = nullptr,
+            };
+        }
     }
 
     static void registry_remove_global(void* data, wl_registry*, uint32_t name)
@@ -543,17 +941,94 @@ namespace mwl {
         }
         else if (name == impl->decoration_manager.name)
         {
-            zxdg_decoration_manager_v1_destroy(impl->decoration_manager);
-        }
-    }
+            if (impl->decoration_manager.ptr)
+            {
+                zxdg_decoration_manager_v1_destroy(impl->decoration_manager.ptr);
+            }
 
-    static constexpr auto registry_listener = wl_registry_listener {
-        .global = registry_receive_global,
+            impl->decoration_manager = {};
+        }
+        else if (name == impl->fractional_scale_manager.name)
+        {
+            if (impl->fractional_scale_manager.ptr)
+            {
+                wp_fractional_scale_manager_v1_destroy(impl->fractional_scale_manager.ptr);
+            }
+
+            impl->fractional_scale_manager = {};
+        }
+        else if (name == impl->viewporter.name)
+        {
+            if (impl->viewporter)
+            {
+                wp_viewporter_destroy(impl->viewporter);
+            }
+
+            impl->viewporter = {};
+        }
+        else if (const auto it = std::ranges::find(impl->outputs, name, [](const auto& output) { return output->global.name; }); it != impl->outputs.end())
+        {
+            if (auto* output = (*it)->global.ptr)
+            {
+                if (wl_output_get_version(output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
+                {
+                    wl_output_release(output);
+                }
+                else
+                {
+                    wl_output_destroy(output);
+                }
+            }
+
+            impl->outputs.erase(it);
+        }
+    }
+
+    static constexpr auto registry_listener = wl_registry_listener {
+        .global = registry_receive_global,
         .global_remove = registry_remove_global,
     };
 
     WaylandStateImpl::~WaylandStateImpl()
     {
+        if (input.thread.joinable())
+        {
+            input.thread.request_stop();
+            eventfd_write(input.stop_fd, 1);
+            input.thread.join();
+
+            // Proxies have to be gone before their queue is destroyed
+            if (input.pointer)
+            {
+                release_pointer(this);
+            }
+
+            if (input.keyboard)
+            {
+                release_keyboard(this);
+            }
+
+            if (timestamps_manager)
+            {
+                zwp_input_timestamps_manager_v1_destroy(timestamps_manager);
+            }
+
+            if (wl_seat_get_version(input.seat) >= WL_SEAT_RELEASE_SINCE_VERSION)
+            {
+                wl_seat_release(input.seat);
+            }
+            else
+            {
+                wl_seat_destroy(input.seat);
+            }
+
+            wl_proxy_wrapper_destroy(input.registry_wrapper);
+            wl_event_queue_destroy(input.queue);
+
+            close(input.stop_fd);
+            close(input.wakeup_fd);
+        }
+
         // NOTE(Peter): Manually invoking these here since it seems like
         //              the wayland server isn't dispatching the calls on display_disconnect.
         registry_remove_global(this, registry, compositor.name);
@@ -565,6 +1040,11 @@ namespace mwl {
         wl_display_roundtrip(display);
         wl_display_disconnect(display);
 
+        if (input.key_repeat.fd != -1)
+        {
+            close(input.key_repeat.fd);
+        }
+
         if (buffers_created > buffers_destroyed)
         {
             std::println("Created {} buffers, destroyed {}", buffers_created.load(), buffers_destroyed.load());
@@ -573,22 +1053,453 @@ namespace mwl {
 
     void WaylandStateImpl::init()
     {
+        using Clock = std::chrono::steady_clock;
+        auto phase_start = Clock::now();
+
         // Connect to the display server
         display = wl_display_connect(nullptr);
 
         registry = wl_display_get_registry(display);
         wl_registry_add_listener(registry, &registry_listener, this);
 
+        if (desc.threaded_input)
+        {
+            input.queue = wl_display_create_queue(display);
+            input.registry_wrapper = static_cast<wl_registry*>(wl_proxy_create_wrapper(registry));
+            wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(input.registry_wrapper), input.queue);
+        }
+
+        // Every compositor has to support these, whether or not they're advertised
+        supported_pixel_formats = pixel_format_bit(PixelFormat::XRGB8888) | pixel_format_bit(PixelFormat::ARGB8888);
+
+        startup_profile.connect = Clock::now() - phase_start;
+        phase_start = Clock::now();
+
         input.ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
 
+        input.key_repeat.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        MWL_VERIFY(input.key_repeat.fd != -1, "Unable to create key repeat timer");
+
+        if (desc.event_loop == EventLoop::IoUring)
+        {
+            #if defined(MWL_USE_IO_URING)
+                io_uring_poller = std::make_unique<IoUringPoller>();
+
+                // The display connection plus the internal fds, with room for a pending POLLOUT
+                if (!io_uring_poller->init(8))
+                {
+                    std::println("Unable to create an io_uring, falling back to poll.");
+                    io_uring_poller = nullptr;
+                }
+            #else
+                std::println("MWL was built without io_uring support, falling back to poll.");
+            #endif
+        }
+
+        startup_profile.setup = Clock::now() - phase_start;
+        phase_start = Clock::now();
+
         // Block until all pending requests are processed by the server.
         // Required to guarantee that e.g compositor is valid
         wl_display_roundtrip(display);
+
+        // wl_shm was only bound during the roundtrip above, its formats arrive with the next one
+        if (shm)
+        {
+            wl_display_roundtrip(display);
+        }
+
+        startup_profile.globals = Clock::now() - phase_start;
+        phase_start = Clock::now();
+
+        if (desc.threaded_input)
+        {
+            // The key repeat timer moves to the input thread, the render thread only waits for queued events
+            input.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            input.wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            MWL_VERIFY(input.stop_fd != -1 && input.wakeup_fd != -1, "Unable to create input thread eventfds");
+
+            internal_fds_storage.push_back(input.wakeup_fd);
+            input.thread = std::jthread([this](std::stop_token stop_token) { run_input_thread(stop_token); });
+        }
+        else
+        {
+            internal_fds_storage.push_back(input.key_repeat.fd);
+        }
+
+        startup_profile.setup += Clock::now() - phase_start;
+    }
+
+    auto WaylandStateImpl::dispatch_events(int32_t timeout_ms) -> bool
+    {
+        auto dispatched = 0;
+
+        // Events may already be queued (e.g from a roundtrip), those have to be dispatched before we're allowed to read
+        while (wl_display_prepare_read(display) != 0)
+        {
+            const auto count = wl_display_dispatch_pending(display);
+            MWL_VERIFY(count != -1, "Lost connection to the Wayland display", false);
+            dispatched += count;
+        }
+
+        // Don't wait for more events if we already have something to hand back
+        if (dispatched > 0)
+        {
+            timeout_ms = 0;
+        }
+
+        auto fds = std::array<pollfd, 2> {
+            pollfd { .fd = wl_display_get_fd(display), .events = POLLIN, .revents = 0 },
+            pollfd { .fd = internal_fds_storage.front(), .events = POLLIN, .revents = 0 },
+        };
+        auto& fd = fds[0];
+
+        // The socket buffer may be full, in which case we have to wait for it to become writable
+        // and flush the remaining requests, otherwise the compositor may never respond to them.
+        if (wl_display_flush(display) == -1)
+        {
+            if (errno != EAGAIN)
+            {
+                wl_display_cancel_read(display);
+                MWL_VERIFY(false, "Lost connection to the Wayland display", false);
+            }
+
+            fd.events |= POLLOUT;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        auto is_readable = false;
+
+        while (true)
+        {
+            const auto result = wait_for_fds(fds, timeout_ms);
+
+            if (result == -1 && errno != EINTR)
+            {
+                wl_display_cancel_read(display);
+                MWL_VERIFY(false, "Failed to poll the Wayland display", false);
+            }
+
+            if (result > 0)
+            {
+                if ((fd.revents & POLLOUT) && wl_display_flush(display) != -1)
+                {
+                    fd.events &= ~POLLOUT;
+                }
+
+                is_readable = (fd.revents & (POLLIN | POLLERR | POLLHUP)) != 0;
+
+                // Internal timers are serviced below, we just need to stop waiting for them
+                if (is_readable || (fds[1].revents & POLLIN))
+                {
+                    break;
+                }
+            }
+
+            // Keep waiting for events after an interrupt or a flush, but only for what's left of the timeout
+            if (timeout_ms > 0)
+            {
+                const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                timeout_ms = static_cast<int32_t>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+            }
+
+            if (result == 0 || timeout_ms == 0)
+            {
+                break;
+            }
+        }
+
+        if (is_readable)
+        {
+            MWL_VERIFY(wl_display_read_events(display) != -1, "Lost connection to the Wayland display", false);
+        }
+        else
+        {
+            wl_display_cancel_read(display);
+        }
+
+        const auto count = wl_display_dispatch_pending(display);
+        MWL_VERIFY(count != -1, "Lost connection to the Wayland display", false);
+
+        const auto processed_internal = process_internal_fds();
+
+        for (const auto& entry : windows)
+        {
+            entry.window->flush_motion_event();
+        }
+
+        return dispatched + count > 0 || processed_internal;
     }
 
-    void WaylandStateImpl::dispatch_events()
+    auto WaylandStateImpl::wait_for_fds(std::span<pollfd> fds, int32_t timeout_ms) -> int32_t
     {
-        wl_display_dispatch(display);
+        #if defined(MWL_USE_IO_URING)
+            if (io_uring_poller)
+            {
+                return io_uring_poller->wait(fds, timeout_ms);
+            }
+        #endif
+
+        return poll(fds.data(), fds.size(), timeout_ms);
+    }
+
+    auto WaylandStateImpl::find_window(wl_surface* surface) const -> WaylandWindowImpl*
+    {
+        const auto it = std::ranges::find(windows, surface, &WindowEntry::surface);
+        return it != windows.end() ? it->window : nullptr;
+    }
+
+    auto WaylandStateImpl::get_outputs(std::span<Output> out) -> size_t
+    {
+        auto is_bound_now = false;
+
+        for (auto& output : outputs)
+        {
+            if (!output->global.ptr)
+            {
+                wl_output_add_listener(output->global.get(registry), &output_listener, output.get());
+                is_bound_now = true;
+            }
+        }
+
+        // Outputs send their properties right after being bound, wait for those once
+        if (is_bound_now)
+        {
+            wl_display_roundtrip(display);
+        }
+
+        const auto count = std::min(out.size(), outputs.size());
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = Output {
+                .name = outputs[i]->name,
+                .description = outputs[i]->description,
+                .make = outputs[i]->make,
+                .model = outputs[i]->model,
+            };
+        }
+
+        return count;
+    }
+
+    void WaylandStateImpl::emit_input_events(std::span<const WaylandInputEvent> events)
+    {
+        if (!desc.threaded_input)
+        {
+            for (const auto& event : events)
+            {
+                deliver_input_event(event);
+            }
+
+            return;
+        }
+
+        // Rather than dropping events (e.g a key release) we wait for the render thread to make room.
+        // It never waits on this thread while draining the queue, so this can't deadlock.
+        while (!input.events.try_push(events))
+        {
+            if (input.thread.get_stop_token().stop_requested())
+            {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+
+        eventfd_write(input.wakeup_fd, 1);
+    }
+
+    void WaylandStateImpl::deliver_input_event(const WaylandInputEvent& event)
+    {
+        auto* window = find_window(event.surface);
+
+        if (!window)
+        {
+            return;
+        }
+
+        std::visit([window]<typename T>(const T& data)
+        {
+            if constexpr (std::same_as<T, KeyEvent>)
+            {
+                window->emit_key_event(data);
+            }
+            else if constexpr (std::same_as<T, MouseMotionEvent>)
+            {
+                window->emit_mouse_motion_event(data);
+            }
+            else if constexpr (std::same_as<T, MouseButtonEvent>)
+            {
+                window->emit_mouse_button_event(data);
+            }
+            else if constexpr (std::same_as<T, MouseScrollEvent>)
+            {
+                window->emit_mouse_scroll_event(data);
+            }
+            else if constexpr (std::same_as<T, WaylandKeyboardLeaveEvent>)
+            {
+                window->clear_held_keys();
+            }
+        }, event.data);
+    }
+
+    void WaylandStateImpl::run_input_thread(std::stop_token stop_token)
+    {
+        auto fds = std::array {
+            pollfd { .fd = wl_display_get_fd(display), .events = POLLIN, .revents = 0 },
+            pollfd { .fd = input.key_repeat.fd, .events = POLLIN, .revents = 0 },
+            pollfd { .fd = input.stop_fd, .events = POLLIN, .revents = 0 },
+        };
+
+        // Same read protocol as dispatch_events, libwayland coordinates the two threads reading from the
+        // connection and routes the seat events to our queue no matter which thread ends up reading them.
+        while (!stop_token.stop_requested())
+        {
+            while (wl_display_prepare_read_queue(display, input.queue) != 0)
+            {
+                if (wl_display_dispatch_queue_pending(display, input.queue) == -1)
+                {
+                    return;
+                }
+            }
+
+            wl_display_flush(display);
+
+            if (poll(fds.data(), fds.size(), -1) == -1 && errno != EINTR)
+            {
+                wl_display_cancel_read(display);
+                return;
+            }
+
+            if (fds[0].revents & (POLLIN | POLLERR | POLLHUP))
+            {
+                if (wl_display_read_events(display) == -1)
+                {
+                    return;
+                }
+            }
+            else
+            {
+                wl_display_cancel_read(display);
+            }
+
+            if (wl_display_dispatch_queue_pending(display, input.queue) == -1)
+            {
+                return;
+            }
+
+            if (fds[1].revents & POLLIN)
+            {
+                process_key_repeat();
+            }
+        }
+    }
+
+    // Don't flood the application with repeats if it hasn't dispatched events for a while
+    static constexpr uint64_t MaxKeyRepeatsPerDispatch = 4;
+
+    auto WaylandStateImpl::process_key_repeat() -> bool
+    {
+        auto expirations = uint64_t{};
+
+        // The timer is non-blocking, so this fails with EAGAIN unless it fired since the last read
+        if (read(input.key_repeat.fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        {
+            return false;
+        }
+
+        if (!input.focused_keyboard_surface)
+        {
+            return false;
+        }
+
+        const auto now = std::chrono::duration_cast<EventTimestamp>(std::chrono::steady_clock::now().time_since_epoch());
+
+        auto events = std::array<WaylandInputEvent, MaxKeyRepeatsPerDispatch>{};
+        const auto count = std::min(expirations, MaxKeyRepeatsPerDispatch);
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            events[i] = {
+                .surface = input.focused_keyboard_surface,
+                .data = KeyEvent(input.key_repeat.key, ButtonState::Pressed, true, now),
+            };
+        }
+
+        emit_input_events(std::span(events).first(count));
+
+        return true;
+    }
+
+    auto WaylandStateImpl::process_internal_fds() -> bool
+    {
+        if (!desc.threaded_input)
+        {
+            return process_key_repeat();
+        }
+
+        // Reset the wakeup before draining, so events pushed while we're draining trigger another wakeup
+        auto wakeups = eventfd_t{};
+        eventfd_read(input.wakeup_fd, &wakeups);
+
+        auto event = WaylandInputEvent{};
+        auto delivered = false;
+
+        while (input.events.try_pop(event))
+        {
+            deliver_input_event(event);
+            delivered = true;
+        }
+
+        return delivered;
+    }
+
+    auto WaylandStateImpl::connection_fd() const -> int32_t
+    {
+        return wl_display_get_fd(display);
+    }
+
+    auto WaylandStateImpl::internal_fds() const -> std::span<const int32_t>
+    {
+        return internal_fds_storage;
+    }
+
+    auto WaylandStateImpl::prepare_read() -> bool
+    {
+        return wl_display_prepare_read(display) == 0;
+    }
+
+    auto WaylandStateImpl::read_events() -> bool
+    {
+        MWL_VERIFY(wl_display_read_events(display) != -1, "Lost connection to the Wayland display", false);
+        return true;
+    }
+
+    void WaylandStateImpl::cancel_read()
+    {
+        wl_display_cancel_read(display);
+    }
+
+    auto WaylandStateImpl::flush() -> bool
+    {
+        if (wl_display_flush(display) != -1)
+        {
+            return true;
+        }
+
+        MWL_VERIFY(errno == EAGAIN, "Lost connection to the Wayland display", false);
+        return false;
+    }
+
+    void WaylandStateImpl::roundtrip()
+    {
+        wl_display_roundtrip(display);
+    }
+
+    auto WaylandStateImpl::is_pixel_format_supported(PixelFormat format) const -> bool
+    {
+        return (supported_pixel_formats & pixel_format_bit(format)) != 0;
     }
 
     auto WaylandStateImpl::get_underlying_resource(UnderlyingResourceID id) const -> void*
@@ -607,6 +1518,7 @@ namespace mwl {
         auto* impl = static_cast<WaylandWindowImpl*>(data);
         xdg_surface_ack_configure(xdg_surface, serial);
         impl->has_valid_surface = true;
+        impl->emit_configured_event();
     }
 
     static constexpr auto surface_listener = xdg_surface_listener { surface_configure };
@@ -625,20 +1537,13 @@ namespace mwl {
         {
             win->width = width;
             win->height = height;
-
-            if (win->size_callback)
-            {
-                win->size_callback(win->width, win->height);
-            }
+            win->emit_size_event();
         }
     }
 
 	static void toplevel_close(void* data, xdg_toplevel*)
 	{
-        if (const auto* win = static_cast<Window::Impl*>(data); win->close_callback)
-        {
-            win->close_callback();
-        }
+        static_cast<Window::Impl*>(data)->emit_close_event();
 	}
 
 	static void toplevel_configure_bounds(void*, xdg_toplevel*, int32_t, int32_t)
@@ -668,12 +1573,59 @@ namespace mwl {
 
     static void fractional_scale_preferred_scale(void* data, wp_fractional_scale_v1*, uint32_t scale)
     {
-        static_cast<WaylandWindowImpl*>(data)->preferred_scaling = scale / 120.0f;
+        auto* win = static_cast<WaylandWindowImpl*>(data);
+        const auto preferred_scaling = scale / 120.0f;
+
+        if (preferred_scaling != win->preferred_scaling)
+        {
+            win->preferred_scaling = preferred_scaling;
+            win->emit_size_event();
+        }
     }
     static constexpr auto fractional_scale_listener = wp_fractional_scale_v1_listener { fractional_scale_preferred_scale };
 
+    static void frame_done(void* data, wl_callback* callback, uint32_t)
+    {
+        auto* win = static_cast<WaylandWindowImpl*>(data);
+
+        wl_callback_destroy(callback);
+        win->frame_done_callback = nullptr;
+        win->is_frame_pending = false;
+
+        if (win->frame_callback)
+        {
+            win->frame_callback();
+        }
+    }
+    static constexpr auto frame_listener = wl_callback_listener { frame_done };
+
     WaylandWindowImpl::~WaylandWindowImpl()
     {
+        std::erase_if(state.unwrap<WaylandStateImpl>()->windows, [this](const auto& entry) { return entry.window == this; });
+
+        if (frame_done_callback)
+        {
+            wl_callback_destroy(frame_done_callback);
+        }
+
+        if (viewport)
+        {
+            wp_viewport_destroy(viewport);
+        }
+
+        // Its listener points at this window, and the slot is reused by the next one
+        if (fractional_scale)
+        {
+            wp_fractional_scale_v1_destroy(fractional_scale);
+        }
+
+        // Has to go before the toplevel it decorates
+        if (xdg_data.decoration)
+        {
+            zxdg_toplevel_decoration_v1_destroy(xdg_data.decoration);
+        }
+
+        buffer_pool.destroy();
         xdg_toplevel_destroy(xdg_data.toplevel);
         xdg_surface_destroy(xdg_data.surface);
         wl_surface_destroy(surface);
@@ -685,6 +1637,7 @@ namespace mwl {
 
         surface = wl_compositor_create_surface(state_impl->compositor);
         wl_surface_set_user_data(surface, this);
+        state_impl->windows.push_back({ surface, this });
 
         xdg_data.surface = xdg_wm_base_get_xdg_surface(state_impl->xdg_data.wm_base, surface);
         xdg_surface_add_listener(xdg_data.surface, &surface_listener, this);
@@ -696,23 +1649,26 @@ namespace mwl {
         xdg_toplevel_set_app_id(xdg_data.toplevel, title.data());
         xdg_toplevel_set_title(xdg_data.toplevel, title.data());
 
-        if (state_impl->decoration_manager)
+        if (auto* decoration_manager = state_impl->decoration_manager.get(state_impl->registry))
         {
-            xdg_data.decoration = zxdg_decoration_manager_v1_get_toplevel_decoration(state_impl->decoration_manager, xdg_data.toplevel);
+            xdg_data.decoration = zxdg_decoration_manager_v1_get_toplevel_decoration(decoration_manager, xdg_data.toplevel);
             zxdg_toplevel_decoration_v1_set_mode(xdg_data.decoration, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
         }
 
-        if (state_impl->fractional_scale_manager)
+        if (auto* fractional_scale_manager = state_impl->fractional_scale_manager.get(state_impl->registry))
         {
-            fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(state_impl->fractional_scale_manager, surface);
+            fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(fractional_scale_manager, surface);
             wp_fractional_scale_v1_add_listener(fractional_scale, &fractional_scale_listener, this);
         }
 
+        if (state_impl->viewporter)
+        {
+            viewport = wp_viewporter_get_viewport(state_impl->viewporter, surface);
+            supports_buffer_scaling = true;
+        }
+
+        // The initial configure arrives in response to this commit, Window::create waits for it with a roundtrip
         wl_surface_commit(surface);
-        
-        // NOTE(Peter): I don't entirely like doing this here, but it does ensure all window properties
-        // are set so that the user can query them immediately.
-        wl_display_roundtrip(state_impl->display);
     }
 
     // NOTE(Peter): Wayland windows won't show up until you draw something to them.
@@ -742,6 +1698,35 @@ namespace mwl {
             xdg_toplevel_unset_fullscreen(xdg_data.toplevel);
     }
 
+    auto WaylandWindowImpl::wait_for_frame(int32_t timeout_ms) -> bool
+    {
+        auto* state_impl = state.unwrap<WaylandStateImpl>();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+        // Goes through the regular dispatch so key repeat, threaded input and coalesced motion
+        // keep being serviced while we wait
+        while (is_frame_pending && !is_close_requested)
+        {
+            if (!state_impl->dispatch_events(timeout_ms) && wl_display_get_error(state_impl->display) != 0)
+            {
+                return false;
+            }
+
+            if (timeout_ms > 0)
+            {
+                const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                timeout_ms = static_cast<int32_t>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+            }
+
+            if (timeout_ms == 0)
+            {
+                break;
+            }
+        }
+
+        return !is_frame_pending;
+    }
+
     auto WaylandWindowImpl::fetch_screen_buffer() -> ScreenBuffer
     {
         auto* state = this->state.unwrap<WaylandStateImpl>();
@@ -752,46 +1737,95 @@ namespace mwl {
             return {};
         }
 
-        const auto stride = width * 4;
-        const auto pixel_buffer_size = stride * height;
-        const auto fd = allocate_shm_file(pixel_buffer_size);
+        const auto buffer_width = scaled_width();
+        const auto buffer_height = scaled_height();
 
-        if (fd == -1)
+        if (buffer_pool.width != buffer_width || buffer_pool.height != buffer_height || buffer_pool.pixel_format != pixel_format)
         {
-            return {};
+            buffer_pool.destroy();
+
+            if (!buffer_pool.init(state->shm, buffer_width, buffer_height, pixel_format))
+            {
+                return {};
+            }
         }
 
-        auto* pixel_buffer = static_cast<uint32_t*>(mmap(nullptr, pixel_buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        // Returns an invalid buffer if the compositor is still holding on to every buffer in the pool.
+        auto* buffer_impl = buffer_pool.acquire();
 
-        if (pixel_buffer == MAP_FAILED)
+        if (!buffer_impl)
         {
-            close(fd);
             return {};
         }
 
-        auto* pool = wl_shm_create_pool(state->shm, fd, pixel_buffer_size);
-        auto* buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-        ++buffers_created;
-        wl_shm_pool_destroy(pool);
-        close(fd);
-
-        auto* buffer_impl = new WaylandScreenBufferImpl();
-        buffer_impl->buffer = buffer;
-        buffer_impl->pixel_buffer = pixel_buffer;
-        buffer_impl->pixel_buffer_size = pixel_buffer_size;
+        buffer_impl->state = this->state;
 
-        wl_buffer_add_listener(buffer, &buffer_listener, buffer_impl);
+        if (preserve_screen_buffer)
+        {
+            buffer_pool.copy_forward(buffer_impl);
+        }
 
         return { buffer_impl };
     }
 
-    void WaylandWindowImpl::present_screen_buffer(const ScreenBuffer buffer) const
+    void WaylandWindowImpl::present_screen_buffer(const ScreenBuffer buffer)
     {
-        if (has_valid_surface)
+        if (!has_valid_surface)
+        {
+            return;
+        }
+
+        auto* buffer_impl = buffer.unwrap<WaylandScreenBufferImpl>();
+
+        // Only keep a single frame callback in flight, presenting multiple times before
+        // the compositor gets around to drawing still only results in one frame.
+        if (!frame_done_callback)
         {
-            wl_surface_attach(surface, buffer.unwrap<WaylandScreenBufferImpl>()->buffer, 0, 0);
-            wl_surface_commit(surface);
+            frame_done_callback = wl_surface_frame(surface);
+            wl_callback_add_listener(frame_done_callback, &frame_listener, this);
+            is_frame_pending = true;
         }
+
+        buffer_pool.mark_presented(buffer_impl);
+        wl_surface_attach(surface, buffer_impl->buffer, 0, 0);
+
+        const auto is_scaled = buffer_impl->width != width || buffer_impl->height != height;
+
+        if (viewport)
+        {
+            // Let the compositor scale the buffer up to the size of the window, -1 unsets the destination
+            const auto destination_width = is_scaled ? width : -1;
+            const auto destination_height = is_scaled ? height : -1;
+
+            if (destination_width != viewport_width || destination_height != viewport_height)
+            {
+                wp_viewport_set_destination(viewport, destination_width, destination_height);
+                viewport_width = destination_width;
+                viewport_height = destination_height;
+            }
+        }
+
+        // Compositors older than wl_surface v4 only support damage in surface coordinates,
+        // which is the same thing as long as we don't scale the buffer.
+        const auto has_damage_buffer = wl_surface_get_version(surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+        const auto damage_surface = has_damage_buffer ? wl_surface_damage_buffer : wl_surface_damage;
+
+        if (buffer_impl->damage.empty() || (is_scaled && !has_damage_buffer))
+        {
+            damage_surface(surface, 0, 0, INT32_MAX, INT32_MAX);
+            buffer_impl->damage.clear();
+        }
+        else
+        {
+            for (const auto& rect : buffer_impl->damage)
+            {
+                damage_surface(surface, rect.x, rect.y, rect.width, rect.height);
+            }
+
+            buffer_impl->damage.clear();
+        }
+
+        wl_surface_commit(surface);
     }
 
     auto WaylandWindowImpl::get_underlying_resource(UnderlyingResourceID id) const -> void*
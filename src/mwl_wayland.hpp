@@ -1,13 +1,24 @@
 #pragma once
 
 #include "mwl_impl.hpp"
+#include "mwl_spsc_queue.hpp"
 #include "wayland-xdg-shell-client-protocol.h"
 #include "wayland-xdg-decoration-client-protocol.h"
 #include "wayland-fractional-scale-client-protocol.h"
+#include "wayland-viewporter-client-protocol.h"
+#include "wayland-input-timestamps-client-protocol.h"
 
 #include <xkbcommon/xkbcommon.h>
 
+#if defined(MWL_USE_IO_URING)
+    #include "mwl_io_uring.hpp"
+#endif
+
+#include <array>
 #include <memory>
+#include <poll.h>
+#include <thread>
+#include <variant>
 
 namespace mwl {
     struct WaylandWindowImpl;
@@ -21,47 +32,99 @@ namespace mwl {
         operator WaylandObj*() { return ptr; }
     };
 
-    enum class WaylandEventType
+    // Optional global that's only recorded when advertised and bound the first time it's needed,
+    // so applications that never use it don't pay for binding it (and for its events) at startup
+    template<typename WaylandObj>
+    struct wayland_lazy_global
     {
-        None,
-        Button,
-        MouseMotion,
-        Scroll
+        const wl_interface* interface;
+        uint32_t name;
+        uint32_t version;
+        WaylandObj* ptr;
+
+        [[nodiscard]] auto is_advertised() const -> bool { return name != 0; }
+
+        // Returns nullptr if the compositor doesn't support the global
+        [[nodiscard]] auto get(wl_registry* registry) -> WaylandObj*
+        {
+            if (!ptr && is_advertised())
+            {
+                ptr = static_cast<WaylandObj*>(wl_registry_bind(registry, name, interface, version));
+            }
+
+            return ptr;
+        }
     };
 
-    struct WaylandEvent
+    // Everything the compositor sent between two wl_pointer.frame events. Frames commonly carry
+    // several events at once (e.g motion and a button, or both scroll axes), all of them are
+    // accumulated here and delivered together once the frame ends.
+    struct WaylandPointerFrame
     {
-        static constexpr auto static_type = WaylandEventType::None;
-        WaylandEventType type = WaylandEventType::None;
+        static constexpr size_t MaxButtons = 8;
+
+        struct Axis
+        {
+            bool has_event;
+
+            // Scroll steps in 1/8ths, see MouseScrollEvent. Only sent for wheels.
+            int8_t value;
+            int8_t scalar;
+
+            // Scroll distance in surface coordinates, sent for every source
+            double distance;
+        };
+
+        // Timestamp of the last event in the frame
+        EventTimestamp timestamp;
+
+        bool has_motion;
+        int32_t x;
+        int32_t y;
+
+        std::array<MouseButtonEvent, MaxButtons> buttons;
+        uint32_t button_count;
+
+        ScrollSource source;
+
+        // Indexed by wl_pointer_axis
+        std::array<Axis, 2> axes;
     };
 
-    struct WaylandMouseButtonEvent : WaylandEvent
+    // The surface lost keyboard focus
+    struct WaylandKeyboardLeaveEvent
     {
-        static constexpr auto static_type = WaylandEventType::Button;
-        uint32_t button;
-        ButtonState state;
     };
 
-    struct WaylandMouseMotionEvent : WaylandEvent
+    // Input on its way from the listeners to the window callbacks. Windows are identified by their surface
+    // and looked up on delivery, since a window may be destroyed while its events are still queued.
+    struct WaylandInputEvent
     {
-        static constexpr auto static_type = WaylandEventType::MouseMotion;
-        int32_t x;
-        int32_t y;
+        wl_surface* surface;
+        std::variant<KeyEvent, MouseMotionEvent, MouseButtonEvent, MouseScrollEvent, WaylandKeyboardLeaveEvent> data;
     };
 
-    struct WaylandMouseScrollEvent : WaylandEvent
+    // Converts compositor event times to CLOCK_MONOTONIC. The protocol leaves the base of event times undefined,
+    // but in practice every compositor uses CLOCK_MONOTONIC, so we only estimate an offset when times are clearly off.
+    struct WaylandInputClock
     {
-        static constexpr auto static_type = WaylandEventType::Scroll;
+        bool is_synchronized;
+        int64_t offset;
 
-        ScrollSource source;
-        ScrollAxis axis;
-        int8_t value;
-        int8_t scalar;
+        // Millisecond timestamps are 32 bit and wrap after ~49 days, this is the last one with the wraps added back
+        uint64_t last_milliseconds;
+
+        auto from_nanoseconds(uint64_t nanoseconds) -> EventTimestamp;
+        auto from_milliseconds(uint32_t milliseconds) -> EventTimestamp;
     };
 
     struct WaylandOutput
     {
-        wayland_global<wl_output> global;
+        wayland_lazy_global<wl_output> global;
+
+        // Set once the compositor sent all properties below
+        bool is_done;
+
         std::string name;
         std::string description;
         std::string make;
@@ -70,17 +133,33 @@ namespace mwl {
 
     struct WaylandStateImpl final : State::Impl
     {
-        ~WaylandStateImpl() override;
+        ~WaylandStateImpl();
 
         wl_display* display;
         wl_registry* registry;
         wayland_global<wl_compositor> compositor;
         wayland_global<wl_shm> shm;
-        wayland_global<zxdg_decoration_manager_v1> decoration_manager;
-        wayland_global<wp_fractional_scale_manager_v1> fractional_scale_manager;
 
+        // Bitmask of PixelFormats advertised by wl_shm
+        uint32_t supported_pixel_formats;
+        wayland_lazy_global<zxdg_decoration_manager_v1> decoration_manager;
+        wayland_lazy_global<wp_fractional_scale_manager_v1> fractional_scale_manager;
+        wayland_global<wp_viewporter> viewporter;
+        wayland_global<zwp_input_timestamps_manager_v1> timestamps_manager;
+
+        // Only bound once get_outputs is first called
         std::vector<std::unique_ptr<WaylandOutput>> outputs;
 
+        // Surfaces are kept next to their windows so find_window scans one dense array
+        // rather than touching every window
+        struct WindowEntry
+        {
+            wl_surface* surface;
+            WaylandWindowImpl* window;
+        };
+
+        std::vector<WindowEntry> windows;
+
         struct {
             wayland_global<wl_seat> seat;
             wl_pointer* pointer;
@@ -90,74 +169,132 @@ namespace mwl {
             xkb_keymap* keymap;
             xkb_state* state;
 
-            WaylandWindowImpl* focused_keyboard_window;
-            WaylandWindowImpl* focused_pointer_window;
+            wl_surface* focused_keyboard_surface;
+            wl_surface* focused_pointer_surface;
+
+            // zwp_input_timestamps_v1 sends a nanosecond timestamp right before the event it belongs to,
+            // which replaces the millisecond time of that event. Zero while there's none pending.
+            zwp_input_timestamps_v1* pointer_timestamps;
+            zwp_input_timestamps_v1* keyboard_timestamps;
+            uint64_t pending_pointer_time;
+            uint64_t pending_keyboard_time;
+            WaylandInputClock clock;
+
+            struct {
+                // timerfd that fires while a repeating key is held down
+                int32_t fd = -1;
+                int32_t rate = 25;
+                int32_t delay = 600;
+                uint32_t key;
+            } key_repeat;
+
+            WaylandPointerFrame pointer_frame;
+
+            // Distance of continuous scroll sources that didn't add up to a whole 1/8 step yet, carried over
+            // between frames so slow touchpad scrolling still scrolls. Indexed by wl_pointer_axis.
+            struct {
+                ScrollSource source{};
+                std::array<double, 2> remainder{};
+            } scroll_accumulator;
+
+            // Only used with State::Desc::threaded_input. The seat and its devices live on their own
+            // queue which is dispatched by the input thread, events are handed back through `events`.
+            wl_event_queue* queue;
+            wl_registry* registry_wrapper;
+            std::jthread thread;
+            int32_t stop_fd = -1;
+            int32_t wakeup_fd = -1;
+            SpscQueue<WaylandInputEvent, 1024> events;
 
-            WaylandMouseButtonEvent* pre_allocated_button_event;
-            WaylandMouseMotionEvent* pre_allocated_motion_event;
-            WaylandMouseScrollEvent* pre_allocated_scroll_event;
-
-            WaylandEvent* current_event;
-            bool skip_current;
-
-            template<typename T>
-            auto allocate_if_null(T*& var) -> T*
-            {
-                if (var != nullptr)
-                {
-                    return var;
-                }
-
-                var = new T();
-                var->type = T::static_type;
-                return var;
-            }
-
-            template<typename T>
-            auto fetch_event() -> T*
-            {
-                switch (T::static_type)
-                {
-                    case WaylandEventType::Button:
-                    {
-                        current_event = allocate_if_null(pre_allocated_button_event);
-                        break;
-                    }
-                    case WaylandEventType::MouseMotion:
-                    {
-                        current_event = allocate_if_null(pre_allocated_motion_event);
-                        break;
-                    }
-                    case WaylandEventType::Scroll:
-                    {
-                        current_event = allocate_if_null(pre_allocated_scroll_event);
-                        break;
-                    }
-                    default:
-                    {
-                        MWL_VERIFY(false, "Unknown Wayland event");
-                        current_event = nullptr;
-                        break;
-                    }
-                }
-
-                return static_cast<T*>(current_event);
-            }
         } input;
 
         struct {
             wayland_global<xdg_wm_base> wm_base;
         } xdg_data;
 
-        void init();
-        void dispatch_events() override;
+        // File descriptors besides the display connection that have to be waited on, see State::internal_fds
+        std::vector<int32_t> internal_fds_storage;
 
-        auto get_underlying_resource(UnderlyingResourceID id) const -> void* override;
+        #if defined(MWL_USE_IO_URING)
+            std::unique_ptr<IoUringPoller> io_uring_poller;
+        #endif
+
+        void init();
+        auto find_window(wl_surface* surface) const -> WaylandWindowImpl*;
+
+        void emit_input_events(std::span<const WaylandInputEvent> events);
+        void deliver_input_event(const WaylandInputEvent& event);
+        void run_input_thread(std::stop_token stop_token);
+        auto process_key_repeat() -> bool;
+        auto process_internal_fds() -> bool;
+        auto wait_for_fds(std::span<pollfd> fds, int32_t timeout_ms) -> int32_t;
+        auto dispatch_events(int32_t timeout_ms) -> bool;
+
+        auto connection_fd() const -> int32_t;
+        auto internal_fds() const -> std::span<const int32_t>;
+        auto prepare_read() -> bool;
+        auto read_events() -> bool;
+        void cancel_read();
+        auto flush() -> bool;
+        void roundtrip();
+
+        auto is_pixel_format_supported(PixelFormat format) const -> bool;
+        auto get_outputs(std::span<Output> out) -> size_t;
+
+        auto get_underlying_resource(UnderlyingResourceID id) const -> void*;
     };
 
     struct WaylandScreenBufferImpl final : ScreenBuffer::Impl
     {
         wl_buffer* buffer;
+
+        // Set while the buffer is either handed out to the user or held by the compositor.
+        // Cleared again once the compositor sends wl_buffer.release.
+        bool is_busy;
+
+        // Value of WaylandBufferPool::frame_count when this buffer was last presented, 0 if never presented
+        uint64_t presented_frame;
+    };
+
+    // A single shm pool that backs a fixed ring of wl_buffers for a window.
+    // The pool is only reallocated when the size of the window changes,
+    // buffers are otherwise recycled as soon as the compositor releases them.
+    struct WaylandBufferPool
+    {
+        static constexpr size_t BufferCount = 3;
+
+        // Rows are padded to a whole number of cache lines
+        static constexpr int32_t RowAlignment = 64;
+
+        // Enough history to bring any buffer in the ring up to date without a full copy
+        static constexpr size_t DamageHistorySize = BufferCount + 1;
+
+        wl_shm_pool* pool = nullptr;
+        uint8_t* memory = nullptr;
+        size_t memory_size = 0;
+
+        int32_t width = 0;
+        int32_t height = 0;
+        PixelFormat pixel_format = PixelFormat::XRGB8888;
+
+        std::array<WaylandScreenBufferImpl, BufferCount> buffers{};
+
+        uint64_t frame_count = 0;
+        WaylandScreenBufferImpl* last_presented = nullptr;
+
+        // Handed out by acquire and not presented yet. ScreenBuffer handles can't tell us when they're dropped,
+        // so the next acquire hands this one out again instead of taking another slot out of the ring.
+        WaylandScreenBufferImpl* fetched = nullptr;
+
+        // Damage of the most recently presented frames, indexed by frame number modulo DamageHistorySize
+        std::array<std::vector<Rect>, DamageHistorySize> damage_history{};
+
+        auto init(wl_shm* shm, int32_t width, int32_t height, PixelFormat pixel_format) -> bool;
+        void destroy();
+
+        [[nodiscard]] auto acquire() -> WaylandScreenBufferImpl*;
+        void mark_presented(WaylandScreenBufferImpl* buffer_impl);
+        void copy_forward(WaylandScreenBufferImpl* buffer_impl);
     };
 
     // NOTE(Peter): Curse you XDG for not providing a XDG_TOPLEVEL_WM_CAPABILITIES_MAX value...
@@ -165,30 +302,41 @@ namespace mwl {
 
     struct WaylandWindowImpl final : Window::Impl
     {
-        ~WaylandWindowImpl() override;
+        ~WaylandWindowImpl();
 
+        // Touched every frame
         wl_surface* surface;
-        wp_fractional_scale_v1* fractional_scale;
-        
+        wl_callback* frame_done_callback = nullptr;
         bool has_valid_surface = false;
 
+        wp_viewport* viewport = nullptr;
+        int32_t viewport_width = -1;
+        int32_t viewport_height = -1;
+
+        WaylandBufferPool buffer_pool;
+
+        // Only touched when the window is created or reconfigured
+        wp_fractional_scale_v1* fractional_scale = nullptr;
+
         struct {
             xdg_surface* surface;
             xdg_toplevel* toplevel;
-            zxdg_toplevel_decoration_v1* decoration;
+            zxdg_toplevel_decoration_v1* decoration = nullptr;
             std::array<bool, XDG_TOPLEVEL_WM_CAPABILITIES_MAX> wm_capabilities;
         } xdg_data;
 
         void init();
 
-        void show() override;
+        void show();
+
+        void set_fullscreen_state(bool fullscreen);
 
-        void set_fullscreen_state(bool fullscreen) override;
+        auto wait_for_frame(int32_t timeout_ms) -> bool;
 
-        [[nodiscard]] auto fetch_screen_buffer() -> ScreenBuffer override;
-        void present_screen_buffer(const ScreenBuffer buffer) const override;
+        [[nodiscard]] auto fetch_screen_buffer() -> ScreenBuffer;
+        void present_screen_buffer(const ScreenBuffer buffer);
 
-        auto get_underlying_resource(UnderlyingResourceID id) const -> void* override;
+        auto get_underlying_resource(UnderlyingResourceID id) const -> void*;
     };
 
 }
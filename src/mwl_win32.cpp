@@ -6,7 +6,7 @@ namespace mwl {
 
     static constexpr auto Win32ClassName = "MWL_WINDOW_CLASS"sv;
 
-    static void create_screen_buffer(HWND hwnd, int32_t width, int32_t height, ScreenBuffer buffer)
+    static void create_screen_buffer(HWND hwnd, State state, int32_t width, int32_t height, ScreenBuffer buffer)
     {
         MWL_VERIFY(buffer.is_valid(), "Invalid buffer passed to create_screen_buffer");
 
@@ -32,6 +32,11 @@ namespace mwl {
 
         buffer_impl->bitmap = CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, reinterpret_cast<void**>(&buffer_impl->pixel_buffer), nullptr, 0);
         buffer_impl->pixel_buffer_size = width * height * sizeof(uint32_t);
+        buffer_impl->state = state;
+        buffer_impl->width = width;
+        buffer_impl->height = height;
+        buffer_impl->stride = width * bytes_per_pixel(PixelFormat::XRGB8888);
+        buffer_impl->pixel_format = PixelFormat::XRGB8888;
 
         ReleaseDC(hwnd, dc);
     }
@@ -55,7 +60,7 @@ namespace mwl {
             }
             case WM_CLOSE:
             {
-                impl->close_callback();
+                impl->emit_close_event();
                 break;
             }
             case WM_DESTROY:
@@ -76,18 +81,15 @@ namespace mwl {
                         impl->back_buffer = { new Win32ScreenBufferImpl() };
                     }
 
-                    create_screen_buffer(impl->window_handle, new_width, new_height, impl->front_buffer);
-                    create_screen_buffer(impl->window_handle, new_width, new_height, impl->back_buffer);
+                    create_screen_buffer(impl->window_handle, impl->state, new_width, new_height, impl->front_buffer);
+                    create_screen_buffer(impl->window_handle, impl->state, new_width, new_height, impl->back_buffer);
 
                     GdiFlush();
 
                     impl->width = new_width;
                     impl->height = new_height;
 
-                    if (impl->size_callback)
-                    {
-                        impl->size_callback(impl->width, impl->height);
-                    }
+                    impl->emit_size_event();
                 }
 
                 break;
@@ -104,6 +106,12 @@ namespace mwl {
                 SelectObject(hdc, old_bmp);
                 DeleteDC(hdc_bmp);
                 EndPaint(hwnd, &ps);
+
+                if (impl->frame_callback)
+                {
+                    impl->frame_callback();
+                }
+
                 break;
             }
             default:
@@ -122,6 +130,8 @@ namespace mwl {
 
     void Win32StateImpl::init()
     {
+        const auto start = std::chrono::steady_clock::now();
+
         window_class = {
             .cbSize = sizeof(WNDCLASSEXA),
             .style = CS_HREDRAW | CS_VREDRAW,
@@ -131,17 +141,75 @@ namespace mwl {
         };
 
         RegisterClassEx(&window_class);
+
+        // There's no connection to open and nothing to wait for, registering the class is all of it
+        startup_profile.setup = std::chrono::steady_clock::now() - start;
     }
 
-    void Win32StateImpl::dispatch_events()
+    auto Win32StateImpl::dispatch_events(int32_t timeout_ms) -> bool
     {
         auto msg = MSG{};
+        auto dispatched = false;
+
+        // MWMO_INPUTAVAILABLE also wakes us up for messages that were already in the queue
+        if (timeout_ms != 0)
+        {
+            MsgWaitForMultipleObjectsEx(0, nullptr, timeout_ms < 0 ? INFINITE : static_cast<DWORD>(timeout_ms), QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        }
 
         while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
         {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
+            dispatched = true;
         }
+
+        return dispatched;
+    }
+
+    // Win32 delivers everything through the thread's message queue, there are no fds to wait on
+    auto Win32StateImpl::connection_fd() const -> int32_t
+    {
+        return -1;
+    }
+
+    auto Win32StateImpl::internal_fds() const -> std::span<const int32_t>
+    {
+        return {};
+    }
+
+    auto Win32StateImpl::prepare_read() -> bool
+    {
+        return true;
+    }
+
+    auto Win32StateImpl::read_events() -> bool
+    {
+        return true;
+    }
+
+    void Win32StateImpl::cancel_read()
+    {
+    }
+
+    auto Win32StateImpl::flush() -> bool
+    {
+        return true;
+    }
+
+    void Win32StateImpl::roundtrip()
+    {
+    }
+
+    // 32-bit BI_RGB DIB sections ignore the top byte, which makes them XRGB8888
+    auto Win32StateImpl::is_pixel_format_supported(PixelFormat format) const -> bool
+    {
+        return format == PixelFormat::XRGB8888;
+    }
+
+    auto Win32StateImpl::get_outputs(std::span<Output>) -> size_t
+    {
+        return 0;
     }
 
     auto Win32StateImpl::get_underlying_resource(UnderlyingResourceID) const -> void*
@@ -174,6 +242,9 @@ namespace mwl {
 
             this
         );
+
+        // CreateWindowExA is synchronous, so the window is usable right away
+        emit_configured_event();
     }
 
     void Win32WindowImpl::show()
@@ -185,15 +256,34 @@ namespace mwl {
     {
     }
 
+    // GDI presents synchronously in WM_PAINT, so there's never a frame pending.
+    // Presenting only invalidates the window, there's never a frame to wait for
+    auto Win32WindowImpl::wait_for_frame(int32_t) -> bool
+    {
+        return true;
+    }
+
     auto Win32WindowImpl::fetch_screen_buffer() -> ScreenBuffer
     {
         std::swap(front_buffer, back_buffer);
         return front_buffer;
     }
 
-    void Win32WindowImpl::present_screen_buffer(const ScreenBuffer) const
+    void Win32WindowImpl::present_screen_buffer(const ScreenBuffer buffer)
     {
-        InvalidateRect(window_handle, nullptr, FALSE);
+        if (buffer->damage.empty())
+        {
+            InvalidateRect(window_handle, nullptr, FALSE);
+            return;
+        }
+
+        for (const auto& damage : buffer->damage)
+        {
+            auto rect = RECT { damage.x, damage.y, damage.x + damage.width, damage.y + damage.height };
+            InvalidateRect(window_handle, &rect, FALSE);
+        }
+
+        buffer->damage.clear();
     }
 
     auto Win32WindowImpl::get_underlying_resource(UnderlyingResourceID) const -> void*
@@ -11,32 +11,45 @@ namespace mwl {
 
     struct Win32StateImpl final : State::Impl
     {
-        ~Win32StateImpl() override;
+        ~Win32StateImpl();
 
         WNDCLASSEXA window_class;
 
         void init();
-        void dispatch_events() override;
+        auto dispatch_events(int32_t timeout_ms) -> bool;
 
-        auto get_underlying_resource(UnderlyingResourceID id) const -> void* override;
+        auto connection_fd() const -> int32_t;
+        auto internal_fds() const -> std::span<const int32_t>;
+        auto prepare_read() -> bool;
+        auto read_events() -> bool;
+        void cancel_read();
+        auto flush() -> bool;
+        void roundtrip();
+
+        auto is_pixel_format_supported(PixelFormat format) const -> bool;
+        auto get_outputs(std::span<Output> out) -> size_t;
+
+        auto get_underlying_resource(UnderlyingResourceID id) const -> void*;
     };
 
     struct Win32WindowImpl final : Window::Impl
     {
-        ~Win32WindowImpl() override;
+        ~Win32WindowImpl();
 
         HWND window_handle;
         ScreenBuffer front_buffer;
         ScreenBuffer back_buffer;
 
         void init();
-        void show() override;
-        void set_fullscreen_state(bool fullscreen) override;
+        void show();
+        void set_fullscreen_state(bool fullscreen);
+
+        auto wait_for_frame(int32_t timeout_ms) -> bool;
 
-        [[nodiscard]] auto fetch_screen_buffer() -> ScreenBuffer override;
-        void present_screen_buffer(const ScreenBuffer buffer) const override;
+        [[nodiscard]] auto fetch_screen_buffer() -> ScreenBuffer;
+        void present_screen_buffer(const ScreenBuffer buffer);
 
-        auto get_underlying_resource(UnderlyingResourceID id) const -> void* override;
+        auto get_underlying_resource(UnderlyingResourceID id) const -> void*;
     };
 
     struct Win32ScreenBufferImpl final : ScreenBuffer::Impl